@@ -0,0 +1,180 @@
+#include <think_parallel/inclusive_scan.hpp>
+#include <think_parallel/copy_if.hpp>
+#include <think_parallel/chunk_by.hpp>
+#include <think_parallel/tuning.hpp>
+#include <think_parallel/benchmark.hpp>
+
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <execution>
+#include <random>
+#include <limits>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+namespace stdr = std::ranges;
+namespace stdv = std::views;
+namespace stde = std::execution;
+namespace tp   = think_parallel;
+
+using stdr::begin;
+using stdr::end;
+using stdr::size;
+
+// Measures where each algorithm's parallel tiers overtake its serial one on
+// this machine and writes the crossover points to a tuning file, which the
+// auto front ends load through THINK_PARALLEL_TUNING.
+//
+// Usage: calibrate [max elements] [tuning file]
+
+auto is_negative = tp::less_than(std::int32_t(0));
+
+auto is_not_space = [] (auto l, auto r) { return !(l == ' ' || r == ' '); };
+
+// Median of a few runs after a warmup run.
+double median_time(auto f) {
+  return tp::measure(f, 1, 5).median;
+}
+
+struct measurement {
+  std::size_t bytes;
+  double serial, multi_pass, decoupled_lookback;
+};
+
+// The smallest size from which a parallel tier wins at every larger size
+// measured, and likewise for decoupled lookback against the multi-pass tier.
+tp::crossover crossover_for(std::vector<measurement> const& ms) {
+  constexpr auto never = std::numeric_limits<std::size_t>::max();
+  tp::crossover c{never, never};
+  for (auto it = ms.rbegin(); it != ms.rend(); ++it) {
+    if (std::min(it->multi_pass, it->decoupled_lookback) >= it->serial)
+      break;
+    c.parallel_bytes = it->bytes;
+  }
+  for (auto it = ms.rbegin(); it != ms.rend(); ++it) {
+    if (it->decoupled_lookback > it->multi_pass || it->bytes < c.parallel_bytes)
+      break;
+    c.lookback_bytes = it->bytes;
+  }
+  c.lookback_bytes = std::max(c.lookback_bytes, c.parallel_bytes);
+  return c;
+}
+
+tp::crossover calibrate(std::string_view name,
+                        std::uint64_t max_elements,
+                        std::size_t element_size,
+                        tp::tuning const& t,
+                        auto run) {
+  std::vector<measurement> ms;
+  for (std::uint64_t n = 4096; n <= max_elements; n *= 2) {
+    auto num_tiles = tp::auto_num_tiles(n, element_size, t);
+    auto time_tier = [&] (tp::algorithm_tier tier) {
+      return median_time([&] { run(n, tier, num_tiles); });
+    };
+    measurement m{n * element_size,
+                  time_tier(tp::algorithm_tier::serial),
+                  time_tier(tp::algorithm_tier::multi_pass),
+                  time_tier(tp::algorithm_tier::decoupled_lookback)};
+    std::cout << name << ", " << n << ", " << num_tiles << ", "
+              << m.serial << ", " << m.multi_pass << ", "
+              << m.decoupled_lookback << "\n";
+    ms.push_back(m);
+  }
+  return crossover_for(ms);
+}
+
+int main(int argc, char** argv) {
+  std::uint64_t max_elements = 16 * 1024 * 1024;
+  std::string path = "think_parallel.tuning";
+
+  if (auto env = std::getenv("THINK_PARALLEL_TUNING"))
+    path = env;
+  if (argc > 1)
+    max_elements = std::stoull(argv[1]);
+  if (argc > 2)
+    path = argv[2];
+
+  std::vector<std::int32_t> values(max_elements), values_out(max_elements);
+  std::vector<char> text(max_elements);
+  std::vector<stdr::subrange<std::vector<char>::iterator>> chunks(max_elements);
+  {
+    std::minstd_rand gen(0);
+    std::uniform_int_distribution<std::int32_t> dis(-100, 100);
+    stdr::generate(values, [&] { return dis(gen); });
+    constexpr std::string_view charset = "abcdefghijklmnopqrstuvxyz ";
+    std::uniform_int_distribution<std::size_t> chars(0, size(charset) - 1);
+    stdr::generate(text, [&] { return charset[chars(gen)]; });
+  }
+
+  tp::tuning t;
+  tp::workspace ws;
+
+  // The tile size that scans the largest input fastest.
+  std::cout << "Tile Size [bytes], Time [s]\n";
+  double best = std::numeric_limits<double>::max();
+  auto cache = tp::tuning::cache_bytes();
+  for (auto tile_bytes : {cache / 4, cache / 2, cache, cache * 2}) {
+    tp::tuning candidate = t;
+    candidate.tile_bytes = std::max<std::size_t>(tile_bytes, 4096);
+    auto num_tiles = tp::auto_num_tiles(max_elements, sizeof(std::int32_t),
+                                        candidate);
+    auto s = median_time([&] {
+      tp::inclusive_scan_decoupled_lookback(values, values_out, num_tiles, ws);
+    });
+    std::cout << candidate.tile_bytes << ", " << s << "\n";
+    if (s < best) {
+      best = s;
+      t.tile_bytes = candidate.tile_bytes;
+    }
+  }
+  std::cout << "\n";
+
+  std::cout << "Algorithm, Number of Elements, Number of Tiles, "
+               "Serial [s], Multi-Pass [s], Decoupled Lookback [s]\n";
+
+  t.scan = calibrate("inclusive_scan", max_elements, sizeof(std::int32_t), t,
+    [&] (std::uint64_t n, tp::algorithm_tier tier, std::uint32_t num_tiles) {
+      std::span in(values.data(), n);
+      std::span out(values_out.data(), n);
+      if (tier == tp::algorithm_tier::serial)
+        tp::local_inclusive_scan(in, out);
+      else if (tier == tp::algorithm_tier::multi_pass)
+        tp::inclusive_scan_upsweep_downsweep(in, out, num_tiles, ws);
+      else
+        tp::inclusive_scan_decoupled_lookback(in, out, num_tiles, ws);
+    });
+
+  t.copy_if = calibrate("copy_if", max_elements, sizeof(std::int32_t), t,
+    [&] (std::uint64_t n, tp::algorithm_tier tier, std::uint32_t num_tiles) {
+      std::span in(values.data(), n);
+      if (tier == tp::algorithm_tier::serial)
+        stdr::copy_if(in, begin(values_out), is_negative);
+      else if (tier == tp::algorithm_tier::multi_pass)
+        tp::copy_if_three_pass(in, begin(values_out), is_negative, num_tiles, ws);
+      else
+        tp::copy_if_fused(in, begin(values_out), is_negative, num_tiles, ws);
+    });
+
+  t.chunk_by = calibrate("chunk_by", max_elements, sizeof(char), t,
+    [&] (std::uint64_t n, tp::algorithm_tier tier, std::uint32_t num_tiles) {
+      auto in = stdr::subrange(begin(text), begin(text) + n);
+      if (tier == tp::algorithm_tier::serial)
+        tp::chunk_by_serial(in, chunks, is_not_space);
+      else if (tier == tp::algorithm_tier::multi_pass)
+        tp::chunk_by_three_pass(in, chunks, is_not_space, num_tiles, ws);
+      else
+        tp::chunk_by_decoupled_lookback(in, chunks, is_not_space, num_tiles, ws);
+    });
+
+  std::ofstream file(path);
+  t.write(file);
+  if (!file)
+    throw int{};
+
+  std::cout << "\nTuning File, " << path << "\n";
+  t.write(std::cout);
+}
@@ -1,16 +1,19 @@
+#include <think_parallel/chunk_by.hpp>
+#include <think_parallel/streaming.hpp>
+#include <think_parallel/benchmark.hpp>
+
 #include <vector>
 #include <ranges>
 #include <algorithm>
-#include <numeric>
 #include <execution>
-#include <atomic>
 #include <random>
-#include <chrono>
 #include <iostream>
+#include <atomic>
 
 namespace stdr = std::ranges;
 namespace stdv = std::views;
 namespace stde = std::execution;
+namespace tp   = think_parallel;
 
 using stdr::begin;
 using stdr::end;
@@ -18,203 +21,36 @@ using stdr::next;
 using stdr::size;
 using stdr::distance;
 
-auto range_for_tile(stdr::range auto&& in,
-                    std::uint32_t tile,
-                    std::uint32_t num_tiles) {
-  auto tile_size = (size(in) + num_tiles - 1) / num_tiles;
-  auto start     = std::min(tile * tile_size, size(in));
-  auto end       = std::min((tile + 1) * tile_size, size(in));
-  return stdr::subrange(next(begin(in), start), next(begin(in), end));
-}
-
-template <typename T>
-struct scan_tile_state {
-  enum status {
-    status_unavailable,
-    status_local,
-    status_complete
-  };
-
-  struct descriptor {
-    T local = {};
-    T complete = {};
-    std::atomic<status> state = status_unavailable;
-  };
-
-  std::vector<descriptor> prefixes;
-
-  scan_tile_state(std::uint32_t num_tiles) : prefixes(num_tiles) {}
-
-  void set_local_prefix(std::uint32_t i, T local) {
-    if (i == 0) {
-      prefixes[i].local = local;
-      prefixes[i].complete = local;
-      prefixes[i].state.store(status_complete,
-                              std::memory_order_release);
-    } else {
-      prefixes[i].local = local;
-      prefixes[i].state.store(status_local,
-                              std::memory_order_release);
-    }
-    prefixes[i].state.notify_all();
-  }
-
-  T wait_for_predecessor_prefix(std::uint32_t i) {
-    T predecessor_prefix = {};
-    for (auto p = i - 1; p >= 0; --p) {
-      auto state = prefixes[p].state.load(std::memory_order_acquire);
-      while (state == status_unavailable) {
-        prefixes[p].state.wait(status_unavailable,
-                               std::memory_order_acquire);
-        state = prefixes[p].state.load(std::memory_order_acquire);
-      }
-      if (state == status_local) {
-        predecessor_prefix = prefixes[p].local
-                           + predecessor_prefix;
-      } else if (state == status_complete) {
-        predecessor_prefix = prefixes[p].complete
-                           + predecessor_prefix;
-        break;
-      }
-    }
-
-    prefixes[i].complete = predecessor_prefix
-                           + prefixes[i].local;
-    prefixes[i].state.store(status_complete,
-                            std::memory_order_release);
-    prefixes[i].state.notify_all();
-
-    return predecessor_prefix;
-  }
-};
-
-struct interval {
-  bool flag = true;
-  std::uint32_t index = 0;
-  std::uint32_t count = 0;
-  std::uint32_t end = 0;
-};
-
-interval operator+(interval l, interval r) {
-  return {r.flag,
-          l.index + r.index,
-          r.index ? r.count : l.count + r.count,
-          l.end + r.end};
-}
-
-auto chunk_by_three_pass = [] (stdr::range auto&& in,
-                               stdr::range auto&& out,
-                               auto op,
-                               std::uint32_t) {
-  std::vector<interval> intervals(size(in) + 1);
-
-  intervals[0] = interval{true, 0, 1, 1};
-
-  auto adj_in = in | stdv::adjacent<2>;
-  std::transform(stde::par, begin(adj_in), end(adj_in), begin(intervals) + 1,
-    [&] (auto lr) { auto [l, r] = lr;
-      bool b = op(l, r);
-      return interval{b, !b, 1, 1};
-    });
-
-  intervals.back() = interval{false, 1, 1, 1};
-
-  std::inclusive_scan(stde::par,
-                      begin(intervals), end(intervals), begin(intervals));
-
-  auto adj_intervals = intervals | stdv::adjacent<2>;
-  std::for_each(stde::par, begin(adj_intervals), end(adj_intervals),
-    [&] (auto lr) { auto [l, r] = lr;
-      if (!r.flag)
-        out[l.index] = stdr::subrange(next(begin(in), l.end - l.count),
-                                      next(begin(in), l.end));
-    });
-
-  return stdr::subrange(begin(out), next(begin(out), intervals.back().index));
-};
-
-auto chunk_by_decoupled_lookback = [] (stdr::range auto&& in,
-                                       stdr::range auto&& out,
-                                       auto op,
-                                       std::uint32_t num_tiles) {
-  scan_tile_state<interval> sts(num_tiles);
-
-  std::atomic<std::uint32_t> tile_counter(0);
-
-  auto all_tiles = stdv::iota(0U, num_tiles);
-  std::for_each(stde::par, begin(all_tiles), end(all_tiles),
-    [&] (auto) {
-      auto tile = tile_counter.fetch_add(1, std::memory_order_relaxed);
-
-      bool is_first_tile    = tile == 0;
-      bool is_last_tile     = tile == num_tiles - 1;
-      bool is_interior_tile = tile > 0 && tile < num_tiles - 1;
-
-      auto sub_in = range_for_tile(in, tile, num_tiles);
-      if (!is_first_tile)
-        sub_in = stdr::subrange(--begin(sub_in), end(sub_in));
-
-      std::vector<interval> intervals(size(sub_in) - is_interior_tile);
-
-      if (is_first_tile)
-        intervals[0] = interval{true, 0, 1, 1};
-
-      auto adj_in = sub_in | stdv::adjacent<2>;
-      std::transform(begin(adj_in), end(adj_in), begin(intervals) + is_first_tile,
-        [&] (auto lr) { auto [l, r] = lr;
-          bool b = op(l, r);
-          return interval{b, !b, 1, 1};
-        });
-
-      if (is_last_tile)
-        intervals.back() = interval{false, 1, 1, 1};
-
-      sts.set_local_prefix(tile,
-        *--std::inclusive_scan(begin(intervals), end(intervals),
-                               begin(intervals)));
-
-      if (!is_first_tile) {
-        auto pred = sts.wait_for_predecessor_prefix(tile);
-        stdr::for_each(intervals, [&] (auto& e) { e = pred + e; });
-      }
-
-      auto adj_intervals = intervals | stdv::adjacent<2>;
-      std::for_each(begin(adj_intervals), end(adj_intervals),
-        [&] (auto lr) { auto [l, r] = lr;
-          if (!r.flag)
-            out[l.index] = stdr::subrange(next(begin(in), l.end - l.count),
-                                          next(begin(in), l.end));
-        });
-    });
-
-  return stdr::subrange(begin(out),
-    next(begin(out), sts.prefixes[num_tiles - 1].complete.index));
-};
-
 auto is_not_space = [] (auto l, auto r) { return !(l == ' ' || r == ' '); };
 
+// The same predicate in a form the vectorized boundary detection recognizes.
+constexpr auto space_delimited = tp::not_delimited_by(' ');
+
 int main(int argc, char** argv) {
-  std::uint32_t num_elements = 1024 * 1024 * 1024;
-  std::uint32_t num_tiles = 1024;
+  std::uint64_t num_elements = 1024 * 1024 * 1024;
+  std::uint32_t num_tiles = 0;
   bool validate = true;
 
   if (argc > 1)
-    num_elements = std::stoul(argv[1]);
-  if (argc > 2)
+    num_elements = std::stoull(argv[1]);
+  if (argc > 2 && std::string_view("auto") != std::string_view(argv[2]))
     num_tiles = std::stoul(argv[2]);
   if (argc > 3)
     validate = std::string_view("true") == std::string_view(argv[3]);
 
-  std::cout << "Number of Elements, " << num_elements << "\n";
-  std::cout << "Number of Tiles, " << num_tiles << "\n";
-  std::cout << "Validate, " << std::boolalpha << validate << "\n";
-  std::cout << "\n";
+  if (num_tiles == 0)
+    num_tiles = tp::auto_num_tiles(num_elements, sizeof(char));
+
+  tp::benchmark_harness harness;
+  harness.describe("Validate", validate);
+  harness.describe("Backend", tp::backend_name);
+  harness.describe("SIMD ISA", tp::to_string(tp::active_simd_isa()));
 
   std::vector<char> in(num_elements);
   auto all_tiles = stdv::iota(0U, num_tiles);
   std::for_each(stde::par, begin(all_tiles), end(all_tiles),
     [&] (std::uint32_t tile) {
-      auto sub_in = range_for_tile(in, tile, num_tiles);
+      auto sub_in = tp::range_for_tile(in, tile, num_tiles);
 
       std::minstd_rand gen(tile);
       std::uniform_int_distribution<std::uint8_t> dis(0, 26);
@@ -231,17 +67,26 @@ int main(int argc, char** argv) {
     gold.resize(distance(begin(gold), end));
   }
 
-  std::cout << "Benchmark, Time [s]\n";
-
-  auto benchmark = [&] (auto f, std::string_view name) {
-    auto start = std::chrono::high_resolution_clock::now();
+  tp::workspace ws;
 
-    auto res = f(in, out, is_not_space, num_tiles);
+  // Reads every element and writes one subrange, or one offset, per chunk.
+  auto num_chunks = std::uint64_t(tp::chunk_by_count(in, is_not_space, num_tiles));
+  auto chunk_case = [&] (std::size_t chunk_size) {
+    return tp::benchmark_case{"char", num_elements, num_tiles,
+                              num_elements + num_chunks * chunk_size};
+  };
 
-    auto finish = std::chrono::high_resolution_clock::now();
+  auto benchmark_as = [&] (std::uint32_t reported_tiles, auto f,
+                           std::string_view name) {
+    // So that a chunk the previous benchmark wrote can not stand in for one
+    // this one missed.
+    if (validate)
+      stdr::fill(out, stdr::range_value_t<decltype(out)>{});
 
-    std::chrono::duration<double> diff = finish - start;
-    std::cout << name << ", " << diff.count() << "\n";
+    auto c = chunk_case(sizeof(out[0]));
+    c.num_tiles = reported_tiles;
+    auto res = harness.run(name, c,
+      [&] { return f(in, out, is_not_space, num_tiles, ws); });
 
     if (validate) {
       static_assert(std::same_as<stdr::range_value_t<decltype(res)>,
@@ -256,9 +101,99 @@ int main(int argc, char** argv) {
     }
   };
 
-  #define BENCHMARK(f) benchmark(f, #f)
+  auto benchmark = [&] (auto f, std::string_view name) {
+    benchmark_as(num_tiles, f, name);
+  };
+
+  #define BENCHMARK(...)                                                          \
+    benchmark([] (auto&&... args)                                                 \
+              { return tp::__VA_ARGS__(std::forward<decltype(args)>(args)...); }, \
+              #__VA_ARGS__)
+
+  BENCHMARK(chunk_by_three_pass<std::uint32_t>);
+  BENCHMARK(chunk_by_three_pass<std::uint64_t>);
+  BENCHMARK(chunk_by_decoupled_lookback<std::uint32_t>);
+  BENCHMARK(chunk_by_decoupled_lookback<std::uint64_t>);
+  // chunk_by_auto ignores the given tile count and picks its own.
+  benchmark_as(tp::auto_num_tiles(num_elements, sizeof(char)),
+               [] (auto&& in, auto&& out, auto op, auto, auto& ws)
+               { return tp::chunk_by_auto(in, out, op, ws); },
+               "chunk_by_auto");
+
+  #define POOL_BENCHMARK(...)                                                     \
+    benchmark([] (auto&&... args)                                                 \
+              { return tp::__VA_ARGS__(tp::pool_executor{},                       \
+                                       std::forward<decltype(args)>(args)...); }, \
+              #__VA_ARGS__ " (pool)")
+
+  POOL_BENCHMARK(chunk_by_decoupled_lookback<std::uint32_t>);
+
+  #undef POOL_BENCHMARK
+
+  #undef BENCHMARK
+
+  auto benchmark_offsets = [&] (auto f, auto op, std::string_view name) {
+    auto offsets = harness.run(name, chunk_case(sizeof(std::uint32_t)),
+      [&] { return f(in, op, num_tiles, ws); });
+
+    if (validate) {
+      if (size(offsets) != size(gold) + 1)
+        throw int{};
+
+      for (std::size_t k = 0; k < size(gold); ++k)
+        if (begin(gold[k]) != next(begin(in), offsets[k])
+         || end(gold[k])   != next(begin(in), offsets[k + 1]))
+          throw bool{};
+    }
+  };
+
+  benchmark_offsets([] (auto&&... args)
+                    { return tp::chunk_by_offsets<std::uint32_t>(args...); },
+                    is_not_space, "chunk_by_offsets<std::uint32_t>");
+  benchmark_offsets([] (auto&&... args)
+                    { return tp::chunk_by_offsets<std::uint64_t>(args...); },
+                    is_not_space, "chunk_by_offsets<std::uint64_t>");
+  benchmark_offsets([] (auto&&... args)
+                    { return tp::chunk_by_offsets<std::uint32_t>(args...); },
+                    space_delimited, "chunk_by_offsets<std::uint32_t>(not_delimited_by)");
+  benchmark_offsets([] (auto&&... args)
+                    { return tp::chunk_by_offsets<std::uint64_t>(args...); },
+                    space_delimited, "chunk_by_offsets<std::uint64_t>(not_delimited_by)");
+  benchmark_offsets([] (auto&& in, auto op, auto num_tiles, auto&)
+                    {
+                      tp::chunk_by_stream<char, decltype(op)> stream(op, num_tiles);
+                      std::vector<std::uint64_t> offsets;
+                      tp::for_each_block<char>(tp::span_reader<char>(in),
+                                               (size(in) + 7) / 8,
+                        [&] (auto block) { stdr::copy(stream(block),
+                                                      std::back_inserter(offsets)); });
+                      offsets.push_back(stream.position);
+                      return offsets;
+                    },
+                    space_delimited, "for_each_block + chunk_by_stream(8 blocks)");
+
+  auto benchmark_for_each = [&] (auto op, std::string_view name) {
+    std::atomic<std::uint64_t> chunks(0), elements(0);
+
+    harness.run(name, chunk_case(0),
+      [&] {
+        chunks = 0;
+        elements = 0;
+        tp::chunk_by_for_each(in, op,
+          [&] (auto chunk) {
+            chunks.fetch_add(1, std::memory_order_relaxed);
+            elements.fetch_add(size(chunk), std::memory_order_relaxed);
+          },
+          num_tiles);
+      });
+
+    if (validate) {
+      if (chunks != size(gold) || elements != num_elements)
+        throw int{};
+    }
+  };
 
-  BENCHMARK(chunk_by_three_pass);
-  BENCHMARK(chunk_by_decoupled_lookback);
+  benchmark_for_each(is_not_space, "chunk_by_for_each");
+  benchmark_for_each(space_delimited, "chunk_by_for_each(not_delimited_by)");
 }
 
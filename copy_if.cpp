@@ -1,16 +1,28 @@
+#include <think_parallel/copy_if.hpp>
+#include <think_parallel/partition.hpp>
+#include <think_parallel/pipeline.hpp>
+#include <think_parallel/async.hpp>
+#include <think_parallel/inclusive_scan.hpp>
+#include <think_parallel/mapped_file.hpp>
+#include <think_parallel/streaming.hpp>
+#include <think_parallel/numa.hpp>
+#include <think_parallel/benchmark.hpp>
+
 #include <vector>
+#include <memory>
+#include <span>
+#include <array>
+#include <string>
 #include <ranges>
 #include <algorithm>
-#include <numeric>
 #include <execution>
-#include <atomic>
 #include <random>
-#include <chrono>
 #include <iostream>
 
 namespace stdr = std::ranges;
 namespace stdv = std::views;
 namespace stde = std::execution;
+namespace tp   = think_parallel;
 
 using stdr::begin;
 using stdr::end;
@@ -18,207 +30,287 @@ using stdr::next;
 using stdr::size;
 using stdr::distance;
 
-auto range_for_tile(stdr::range auto&& in,
-                    std::uint32_t tile,
-                    std::uint32_t num_tiles) {
-  auto tile_size = (size(in) + num_tiles - 1) / num_tiles;
-  auto start     = std::min(tile * tile_size, size(in));
-  auto end       = std::min((tile + 1) * tile_size, size(in));
-  return stdr::subrange(next(begin(in), start), next(begin(in), end));
-}
-
-template <typename T>
-struct scan_tile_state {
-  enum status {
-    status_unavailable,
-    status_local,
-    status_complete
-  };
-
-  struct descriptor {
-    T local = {};
-    T complete = {};
-    std::atomic<status> state = status_unavailable;
-  };
-
-  std::vector<descriptor> prefixes;
-
-  scan_tile_state(std::uint32_t num_tiles) : prefixes(num_tiles) {}
-
-  void set_local_prefix(std::uint32_t i, T local) {
-    if (i == 0) {
-      prefixes[i].local = local;
-      prefixes[i].complete = local;
-      prefixes[i].state.store(status_complete,
-                              std::memory_order_release);
-    } else {
-      prefixes[i].local = local;
-      prefixes[i].state.store(status_local,
-                              std::memory_order_release);
-    }
-    prefixes[i].state.notify_all();
-  }
-
-  T wait_for_predecessor_prefix(std::uint32_t i) {
-    T predecessor_prefix = {};
-    for (auto p = i - 1; p >= 0; --p) {
-      auto state = prefixes[p].state.load(std::memory_order_acquire);
-      while (state == status_unavailable) {
-        prefixes[p].state.wait(status_unavailable,
-                               std::memory_order_acquire);
-        state = prefixes[p].state.load(std::memory_order_acquire);
-      }
-      if (state == status_local) {
-        predecessor_prefix = prefixes[p].local
-                           + predecessor_prefix;
-      } else if (state == status_complete) {
-        predecessor_prefix = prefixes[p].complete
-                           + predecessor_prefix;
-        break;
-      }
-    }
+auto is_negative = tp::less_than(std::int32_t(0));
 
-    prefixes[i].complete = predecessor_prefix
-                           + prefixes[i].local;
-    prefixes[i].state.store(status_complete,
-                            std::memory_order_release);
-    prefixes[i].state.notify_all();
+// The pipeline stages: shift into unsigned by flipping the sign bit, so
+// that the sums wrap instead of overflowing and any input, e.g. one read
+// from a file, keeps its order, keep what was negative, and prefix-sum the
+// survivors.
+auto shift = [] (std::int32_t e) { return std::uint32_t(e) ^ 0x80000000U; };
+auto was_negative = [] (std::uint32_t e) { return e < 0x80000000U; };
 
-    return predecessor_prefix;
-  }
+auto quartile = [] (std::int32_t e) {
+  return e < -50 ? 0 : e < 0 ? 1 : e < 50 ? 2 : 3;
 };
 
-auto copy_if_three_pass = [] (stdr::range auto&& in,
-                              auto out,
-                              auto op,
-                              std::uint32_t) {
-  std::vector<std::uint8_t> flags(size(in));
-
-  std::transform(stde::par, begin(in), end(in), begin(flags), op);
-
-  std::vector<std::uint32_t> indices(size(in) + 1);
-
-  auto flags_as_index = flags
-                      | stdv::transform([] (auto b)
-                                        { return std::uint32_t(b); });
-  std::inclusive_scan(stde::par,
-                      begin(flags_as_index), end(flags_as_index),
-                      begin(indices) + 1);
-
-  auto zipped = stdv::zip(in, flags, indices);
-  std::for_each(stde::par, begin(zipped), end(zipped),
-    [&] (auto z) { auto [e, flag, index] = z;
-      if (flag) out[index] = e;
-    });
+// Usage: copy_if [elements] [tiles] [validate] [input file] [output file]
+//
+// elements and tiles are comma separated lists, and tiles may be "auto";
+// every combination is run. Input and output files hold raw int32s.
+int main(int argc, char** argv) {
+  std::vector<std::uint64_t> element_counts{1024 * 1024 * 1024};
+  std::vector<std::uint64_t> tile_counts{0};
+  bool validate = true;
 
-  return stdr::subrange(out, next(out, indices.back()));
-};
+  if (argc > 1)
+    element_counts = tp::parse_list(argv[1]);
+  if (argc > 2)
+    tile_counts = tp::parse_list(argv[2]);
+  if (argc > 3)
+    validate = std::string_view("true") == std::string_view(argv[3]);
 
-auto copy_if_decoupled_lookback = [] (stdr::range auto&& in,
-                                      auto out,
-                                      auto op,
-                                      std::uint32_t num_tiles) {
-  scan_tile_state<std::uint32_t> sts(num_tiles);
+  // Optionally read the input from, and write the output to, raw int32 files
+  // mapped into memory instead of generated heap vectors.
+  tp::mapped_file input_file;
+  if (argc > 4 && *argv[4]) {
+    input_file = tp::mapped_file(std::string(argv[4]));
+    element_counts = {size(input_file.as<std::int32_t const>())};
+  }
+  char const* output_path = argc > 5 && *argv[5] ? argv[5] : nullptr;
 
-  std::atomic<std::uint32_t> tile_counter(0);
+  tp::benchmark_harness harness;
+  harness.describe("Validate", validate);
+  harness.describe("Backend", tp::backend_name);
+  harness.describe("SIMD ISA", tp::to_string(tp::active_simd_isa()));
+  harness.describe("NUMA Nodes", size(tp::numa_nodes()));
 
-  auto all_tiles = stdv::iota(0U, num_tiles);
-  std::for_each(stde::par, begin(all_tiles), end(all_tiles),
-    [&] (auto) {
-      auto tile = tile_counter.fetch_add(1, std::memory_order_relaxed);
+  tp::workspace ws;
 
-      auto sub_in = range_for_tile(in, tile, num_tiles);
+  tp::async_scheduler scheduler;
+  tp::workspace first_half_ws, second_half_ws;
 
-      std::vector<std::uint8_t> flags(size(sub_in));
-      stdr::transform(sub_in, begin(flags), op);
+  for (std::uint64_t num_elements : element_counts)
+  for (std::uint32_t num_tiles : tile_counts) {
+    if (num_tiles == 0)
+      num_tiles = tp::auto_num_tiles(num_elements, sizeof(std::int32_t));
 
-      std::vector<std::uint32_t> indices(size(sub_in) + 1);
+    // Heap storage is left untouched on allocation, and then first touched
+    // tile by tile, mostly on the NUMA node that will process each tile.
+    std::unique_ptr<std::int32_t[]> in_storage, out_storage;
+    std::span<std::int32_t const> in;
+    std::span<std::int32_t> out;
 
-      auto flags_as_index = flags
-                          | stdv::transform([] (auto b)
-                                            { return std::uint32_t(b); });
-      sts.set_local_prefix(tile,
-        *--std::inclusive_scan(begin(flags_as_index), end(flags_as_index),
-                               begin(indices) + 1));
+    if (input_file.data) {
+      in = input_file.as<std::int32_t const>();
+    } else {
+      in_storage = std::make_unique_for_overwrite<std::int32_t[]>(num_elements);
+      std::span<std::int32_t> all_in(in_storage.get(), num_elements);
+      tp::for_each_tile(tp::numa_executor(), num_tiles,
+        [&] (std::uint32_t tile) {
+          auto sub_in = tp::range_for_tile(all_in, tile, num_tiles);
 
-      if (tile != 0) {
-        auto pred = sts.wait_for_predecessor_prefix(tile);
-        stdr::for_each(indices, [&] (auto& e) { e = pred + e; });
-      }
+          std::minstd_rand gen(tile);
+          std::uniform_int_distribution<std::int32_t> dis(-100, 100);
 
-      stdr::for_each(stdv::zip(sub_in, flags, indices),
-        [&] (auto z) { auto [e, flag, index] = z;
-          if (flag) out[index] = e;
+          stdr::generate(sub_in, [&] { return dis(gen); });
         });
-    });
+      in = all_in;
+    }
 
-  return stdr::subrange(out, next(out, sts.prefixes[num_tiles - 1].complete));
-};
+    tp::mapped_file output_file;
+    if (output_path) {
+      output_file = tp::mapped_file(std::string(output_path),
+                                    num_elements * sizeof(std::int32_t));
+      out = output_file.as<std::int32_t>();
+    } else {
+      out_storage = std::make_unique_for_overwrite<std::int32_t[]>(num_elements);
+      out = std::span(out_storage.get(), num_elements);
+      tp::first_touch(tp::numa_executor(), out, num_tiles);
+    }
 
-auto is_negative = [] (auto e) { return e < 0; };
+    std::vector<std::int32_t> gold;
+    if (validate) {
+      gold.resize(num_elements);
+      auto end = stdr::copy_if(in, begin(gold), is_negative).out;
+      gold.resize(distance(begin(gold), end));
+    }
 
-int main(int argc, char** argv) {
-  std::uint32_t num_elements = 1024 * 1024 * 1024;
-  std::uint32_t num_tiles = 1024;
-  bool validate = true;
+    // Reads every element and writes the selected ones.
+    auto num_selected = std::uint64_t(stdr::count_if(in, is_negative));
+    tp::benchmark_case c{"int32", num_elements, num_tiles,
+                         (num_elements + num_selected) * sizeof(std::int32_t)};
 
-  if (argc > 1)
-    num_elements = std::stoul(argv[1]);
-  if (argc > 2)
-    num_tiles = std::stoul(argv[2]);
-  if (argc > 3)
-    validate = std::string_view("true") == std::string_view(argv[3]);
+    auto benchmark_as = [&] (tp::benchmark_case const& bc, auto f,
+                             std::string_view name) {
+      auto res = harness.run(name, bc,
+        [&] { return f(in, begin(out), is_negative, num_tiles, ws); });
 
-  std::cout << "Number of Elements, " << num_elements << "\n";
-  std::cout << "Number of Tiles, " << num_tiles << "\n";
-  std::cout << "Validate, " << std::boolalpha << validate << "\n";
-  std::cout << "\n";
+      if (validate) {
+        if (size(res) != size(gold))
+          throw int{};
 
-  std::vector<std::int32_t> in(num_elements);
-  auto all_tiles = stdv::iota(0U, num_tiles);
-  std::for_each(stde::par, begin(all_tiles), end(all_tiles),
-    [&] (std::uint32_t tile) {
-      auto sub_in = range_for_tile(in, tile, num_tiles);
+        if (!stdr::equal(res, gold))
+          throw bool{};
+      }
+    };
+
+    auto benchmark = [&] (auto f, std::string_view name) {
+      benchmark_as(c, f, name);
+    };
+
+    #define BENCHMARK(...)                                                          \
+      benchmark([] (auto&&... args)                                                 \
+                { return tp::__VA_ARGS__(std::forward<decltype(args)>(args)...); }, \
+                #__VA_ARGS__)
+
+    BENCHMARK(copy_if_three_pass<std::uint32_t>);
+    BENCHMARK(copy_if_three_pass<std::uint64_t>);
+    BENCHMARK(copy_if_decoupled_lookback<std::uint32_t>);
+    BENCHMARK(copy_if_decoupled_lookback<std::uint64_t>);
+    BENCHMARK(copy_if_fused<std::uint32_t, tp::predicate_evaluation::reevaluate>);
+    BENCHMARK(copy_if_fused<std::uint32_t, tp::predicate_evaluation::bitmask>);
+    BENCHMARK(copy_if_fused<std::uint32_t>);
+    // copy_if_auto ignores the given tile count and picks its own.
+    auto auto_case = c;
+    auto_case.num_tiles = tp::auto_num_tiles(num_elements, sizeof(std::int32_t));
+    benchmark_as(auto_case,
+                 [] (auto&& in, auto out, auto op, auto, auto& ws)
+                 { return tp::copy_if_auto(in, out, op, ws); },
+                 "copy_if_auto");
+    benchmark([] (auto&& in, auto out, auto op, auto num_tiles, auto&) {
+        tp::copy_if_stream stream(op, num_tiles);
+        tp::for_each_block<std::int32_t>(tp::span_reader<std::int32_t>(in),
+                                         (size(in) + 7) / 8,
+          [&] (auto block) { stream(block, out); });
+        return stdr::subrange(out, next(out, stream.count));
+      },
+      "for_each_block + copy_if_stream(8 blocks)");
+
+    #define POOL_BENCHMARK(...)                                                     \
+      benchmark([] (auto&&... args)                                                 \
+                { return tp::__VA_ARGS__(tp::pool_executor{},                       \
+                                         std::forward<decltype(args)>(args)...); }, \
+                #__VA_ARGS__ " (pool)")
+
+    POOL_BENCHMARK(copy_if_decoupled_lookback<std::uint32_t>);
+    POOL_BENCHMARK(copy_if_fused<std::uint32_t>);
+
+    #undef POOL_BENCHMARK
+
+    #define NUMA_BENCHMARK(...)                                                     \
+      benchmark([] (auto&&... args)                                                 \
+                { return tp::__VA_ARGS__(tp::numa_executor(),                       \
+                                         std::forward<decltype(args)>(args)...); }, \
+                #__VA_ARGS__ " (numa)")
+
+    NUMA_BENCHMARK(copy_if_fused<std::uint32_t>);
+
+    #undef NUMA_BENCHMARK
+
+    // The same copy_if as two operations in flight at once, one per half of
+    // the input, whose tiles interleave on the pool. The second half's
+    // output offset is counted up front.
+    auto first_half_selected = std::uint64_t(
+      stdr::count_if(in.first(num_elements / 2), is_negative));
+    benchmark([&] (auto&& in, auto out, auto op, std::uint32_t num_tiles, auto&) {
+        auto half = size(in) / 2;
+        auto first  = tp::copy_if_async(scheduler, in.first(half), out, op,
+                                        std::max(num_tiles / 2, 1U),
+                                        first_half_ws);
+        auto second = tp::copy_if_async(scheduler, in.subspan(half),
+                                        out + first_half_selected, op,
+                                        std::max(num_tiles / 2, 1U),
+                                        second_half_ws);
+        first.wait();
+        return stdr::subrange(out, end(second.get()));
+      },
+      "copy_if_async<std::uint32_t> x2 (pool)");
+
+    // Both sides of the predicate in one pass, the false side written right
+    // after the true side, so out ends up stably partitioned.
+    tp::benchmark_case both{"int32", num_elements, num_tiles,
+                            2 * num_elements * sizeof(std::int32_t)};
+
+    auto [selected, rejected] = harness.run(
+      "partition_copy_decoupled_lookback<std::uint32_t>", both,
+      [&] {
+        return tp::partition_copy_decoupled_lookback(
+          in, begin(out), begin(out) + num_selected, is_negative, num_tiles, ws);
+      });
 
-      std::minstd_rand gen(tile);
-      std::uniform_int_distribution<std::int32_t> dis(-100, 100);
+    if (validate) {
+      if (size(selected) != num_selected || end(rejected) != end(out))
+        throw int{};
+
+      std::vector<std::int32_t> partitioned(begin(in), end(in));
+      stdr::stable_partition(partitioned, is_negative);
+      if (!stdr::equal(out, partitioned))
+        throw bool{};
+    }
 
-      stdr::generate(sub_in, [&] { return dis(gen); });
-    });
+    // Four buckets by value, each written to its own part of out.
+    std::array<std::uint64_t, 4> bucket_sizes{};
+    for (auto e : in)
+      ++bucket_sizes[quartile(e)];
+    std::array<std::int32_t*, 4> buckets;
+    for (std::uint64_t b = 0, start = 0; b < size(buckets); ++b) {
+      buckets[b] = out.data() + start;
+      start += bucket_sizes[b];
+    }
 
-  std::vector<std::int32_t> out(num_elements);
+    auto split = harness.run("split_decoupled_lookback<std::uint32_t>", both,
+      [&] {
+        return tp::split_decoupled_lookback(in, buckets, quartile, num_tiles, ws);
+      });
 
-  std::vector<std::int32_t> gold;
-  if (validate) {
-    gold.resize(num_elements);
-    auto end = stdr::copy_if(in, begin(gold), is_negative).out;
-    gold.resize(distance(begin(gold), end));
-  }
+    if (validate) {
+      for (std::uint64_t b = 0; b < size(buckets); ++b)
+        if (size(split[b]) != bucket_sizes[b])
+          throw int{};
 
-  std::cout << "Benchmark, Time [s]\n";
+      std::vector<std::int32_t> sorted(begin(in), end(in));
+      stdr::stable_sort(sorted, stdr::less{}, quartile);
+      if (!stdr::equal(out, sorted))
+        throw bool{};
+    }
 
-  auto benchmark = [&] (auto f, std::string_view name) {
-    auto start = std::chrono::high_resolution_clock::now();
+    // transform, then copy_if, then scan: once as three passes through
+    // full-size intermediates, and once fused into a single tile pass.
+    tp::benchmark_case chained{"int32", num_elements, num_tiles,
+                               (num_elements + num_selected)
+                               * sizeof(std::int32_t)};
+
+    std::vector<std::uint32_t> sums(num_selected);
+    std::vector<std::uint32_t> shifted(num_elements);
+    std::vector<std::uint32_t> selected_shifted(num_elements);
+
+    auto unfused = harness.run("transform + copy_if_fused + inclusive_scan", chained,
+      [&] {
+        std::transform(stde::par, begin(in), end(in), begin(shifted), shift);
+        auto kept = tp::copy_if_fused(shifted, begin(selected_shifted),
+                                      was_negative, num_tiles, ws);
+        tp::inclusive_scan_decoupled_lookback(kept, sums, num_tiles, ws);
+        return size(kept);
+      });
+
+    std::vector<std::uint32_t> gold_sums;
+    if (validate) {
+      std::uint32_t sum = 0;
+      for (auto e : in)
+        if (was_negative(shift(e)))
+          gold_sums.push_back(sum += shift(e));
 
-    auto res = f(in, begin(out), is_negative, num_tiles);
+      if (unfused != num_selected)
+        throw int{};
 
-    auto finish = std::chrono::high_resolution_clock::now();
+      if (!stdr::equal(sums, gold_sums))
+        throw bool{};
+    }
+    shifted = {};
+    selected_shifted = {};
 
-    std::chrono::duration<double> diff = finish - start;
-    std::cout << name << ", " << diff.count() << "\n";
+    tp::pipeline chain{tp::transform_stage{shift},
+                       tp::filter_stage{was_negative},
+                       tp::scan_stage{std::plus<>{}}};
+    auto fused = harness.run("run_pipeline transform + filter + scan", chained,
+      [&] { return tp::run_pipeline(chain, in, begin(sums), num_tiles, ws); });
 
     if (validate) {
-      if (size(res) != size(gold))
+      if (size(fused) != num_selected)
         throw int{};
 
-      if (!stdr::equal(res, gold))
+      if (!stdr::equal(fused, gold_sums))
         throw bool{};
     }
-  };
-
-  #define BENCHMARK(f) benchmark(f, #f)
-
-  BENCHMARK(copy_if_three_pass);
-  BENCHMARK(copy_if_decoupled_lookback);
+  }
 }
-
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/workspace.hpp>
+#include <think_parallel/instrument.hpp>
+#include <think_parallel/executor.hpp>
+#include <think_parallel/tuning.hpp>
+#include <think_parallel/numa.hpp>
+#include <think_parallel/benchmark.hpp>
+#include <think_parallel/scan_tile_state.hpp>
+#include <think_parallel/simd.hpp>
+#include <think_parallel/predicates.hpp>
+#include <think_parallel/stream_compaction.hpp>
+#include <think_parallel/local_scan.hpp>
+#include <think_parallel/inclusive_scan.hpp>
+#include <think_parallel/scan.hpp>
+#include <think_parallel/segmented_scan.hpp>
+#include <think_parallel/copy_if.hpp>
+#include <think_parallel/partition.hpp>
+#include <think_parallel/radix_sort.hpp>
+#include <think_parallel/pipeline.hpp>
+#include <think_parallel/async.hpp>
+#include <think_parallel/chunk_boundaries.hpp>
+#include <think_parallel/chunk_by.hpp>
+#include <think_parallel/streaming.hpp>
+#include <think_parallel/mapped_file.hpp>
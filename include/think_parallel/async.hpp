@@ -0,0 +1,183 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/workspace.hpp>
+#include <think_parallel/executor.hpp>
+#include <think_parallel/inclusive_scan.hpp>
+#include <think_parallel/copy_if.hpp>
+#include <think_parallel/chunk_by.hpp>
+
+#include <ranges>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <stop_token>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <exception>
+
+namespace think_parallel {
+
+// Runs operations in the background on a shared thread_pool. Each operation
+// is driven by one of a few driver threads, which submits its tiles to the
+// pool and takes part in them, so the thread that started it is free to do
+// other work. With several operations in flight their tiles interleave on
+// the pool's workers, up to thread_pool::max_jobs operations at a time.
+//
+// Queued operations still run when the scheduler is destroyed; the
+// destructor waits for them.
+struct async_scheduler {
+  thread_pool* pool;
+  std::mutex mutex;
+  std::condition_variable_any ready;
+  std::deque<std::move_only_function<void()>> tasks;
+  std::vector<std::jthread> drivers;
+
+  explicit async_scheduler(thread_pool& pool = default_thread_pool(),
+                           unsigned num_drivers = 4)
+    : pool(&pool) {
+    for (unsigned d = 0; d < std::max(num_drivers, 1U); ++d)
+      drivers.emplace_back([this] (std::stop_token stop) { drive(stop); });
+  }
+
+  async_scheduler(async_scheduler const&) = delete;
+  async_scheduler& operator=(async_scheduler const&) = delete;
+
+  pool_executor executor() const {
+    return {pool};
+  }
+
+  void submit(std::move_only_function<void()> task) {
+    {
+      std::lock_guard lock(mutex);
+      tasks.push_back(std::move(task));
+    }
+    ready.notify_one();
+  }
+
+  void drive(std::stop_token stop) {
+    for (;;) {
+      std::move_only_function<void()> task;
+      {
+        std::unique_lock lock(mutex);
+        if (!ready.wait(lock, stop, [&] { return !tasks.empty(); }))
+          return;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      task();
+    }
+  }
+};
+
+// Runs f(exec) on one of sched's drivers, with exec running on sched's pool,
+// and returns a future for its result. Exceptions from f end up in the
+// future.
+auto async_invoke(async_scheduler& sched, auto f) {
+  using R = std::invoke_result_t<decltype(f)&, pool_executor>;
+
+  std::promise<R> promise;
+  auto future = promise.get_future();
+  sched.submit(
+    [f = std::move(f), promise = std::move(promise), exec = sched.executor()]
+    () mutable {
+      try {
+        if constexpr (std::is_void_v<R>) {
+          f(exec);
+          promise.set_value();
+        } else {
+          promise.set_value(f(exec));
+        }
+      } catch (...) {
+        promise.set_exception(std::current_exception());
+      }
+    });
+  return future;
+}
+
+// As above, but instead of returning a future, calls on_complete on the
+// driver thread with f's result, or with nothing if f returns void. As with
+// the executors, an exception escaping f or on_complete calls std::terminate.
+void async_invoke(async_scheduler& sched, auto f, auto on_complete) {
+  using R = std::invoke_result_t<decltype(f)&, pool_executor>;
+
+  sched.submit(
+    [f = std::move(f), on_complete = std::move(on_complete),
+     exec = sched.executor()] () mutable noexcept {
+      if constexpr (std::is_void_v<R>) {
+        f(exec);
+        on_complete();
+      } else {
+        on_complete(f(exec));
+      }
+    });
+}
+
+// Asynchronous versions of the single-pass algorithms. Ranges are held as
+// views, so containers passed as lvalues, as well as ws, must outlive the
+// operation, and ws must not be used by anything else until it completes.
+// Each takes either nothing more, and returns a future, or an on_complete
+// callback.
+
+// A range that can be held past the call: an lvalue, or a view.
+template <typename R>
+concept async_range = stdr::viewable_range<R>
+                   && (std::is_lvalue_reference_v<R>
+                       || stdr::view<std::remove_cvref_t<R>>);
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial>
+auto inclusive_scan_async(async_scheduler& sched,
+                          async_range auto&& in,
+                          async_range auto&& out,
+                          std::uint32_t num_tiles,
+                          workspace& ws,
+                          auto... on_complete) {
+  static_assert(sizeof...(on_complete) <= 1);
+  return async_invoke(sched,
+    [in  = stdv::all(std::forward<decltype(in)>(in)),
+     out = stdv::all(std::forward<decltype(out)>(out)),
+     num_tiles, &ws] (auto exec) mutable {
+      inclusive_scan_decoupled_lookback<Layout, Lookback>(
+        exec, in, out, num_tiles, ws);
+    }, on_complete...);
+}
+
+template <typename Index = std::uint32_t>
+auto copy_if_async(async_scheduler& sched,
+                   async_range auto&& in,
+                   auto out,
+                   auto op,
+                   std::uint32_t num_tiles,
+                   workspace& ws,
+                   auto... on_complete) {
+  static_assert(sizeof...(on_complete) <= 1);
+  return async_invoke(sched,
+    [in = stdv::all(std::forward<decltype(in)>(in)),
+     out, op, num_tiles, &ws] (auto exec) mutable {
+      return copy_if_fused<Index>(exec, in, out, op, num_tiles, ws);
+    }, on_complete...);
+}
+
+template <typename Index = std::uint32_t>
+auto chunk_by_async(async_scheduler& sched,
+                    async_range auto&& in,
+                    async_range auto&& out,
+                    auto op,
+                    std::uint32_t num_tiles,
+                    workspace& ws,
+                    auto... on_complete) {
+  static_assert(sizeof...(on_complete) <= 1);
+  return async_invoke(sched,
+    [in  = stdv::all(std::forward<decltype(in)>(in)),
+     out = stdv::all(std::forward<decltype(out)>(out)),
+     op, num_tiles, &ws] (auto exec) mutable {
+      return chunk_by_decoupled_lookback<Index>(exec, in, out, op, num_tiles, ws);
+    }, on_complete...);
+}
+
+} // namespace think_parallel
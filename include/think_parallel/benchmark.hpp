@@ -0,0 +1,252 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/instrument.hpp>
+
+#include <vector>
+#include <ranges>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <optional>
+#include <type_traits>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace think_parallel {
+
+// The harness the drivers share. Each benchmark is run warmup times
+// untimed, so page faults and lazy initialization are paid outside the
+// measurement, and then timed repetitions times. One row is reported per
+// benchmark, as CSV or as JSON.
+//
+// THINK_PARALLEL_BENCHMARK_FORMAT          csv (default) or json
+// THINK_PARALLEL_BENCHMARK_WARMUP          untimed runs, default 1
+// THINK_PARALLEL_BENCHMARK_REPETITIONS     timed runs, default 5
+// THINK_PARALLEL_TRACE                     with THINK_PARALLEL_INSTRUMENT, the
+//                                          file to write the per-tile timeline
+//                                          of each benchmark's last run to, in
+//                                          Chrome trace format
+
+// A comma separated list of counts; "auto" is parsed as 0.
+inline std::vector<std::uint64_t> parse_list(std::string_view arg) {
+  std::vector<std::uint64_t> values;
+  for (auto&& v : arg | stdv::split(',')) {
+    std::string s(begin(v), end(v));
+    values.push_back(s == "auto" ? 0 : std::stoull(s));
+  }
+  return values;
+}
+
+// A comma separated list of names.
+inline std::vector<std::string> parse_names(std::string_view arg) {
+  std::vector<std::string> names;
+  for (auto&& v : arg | stdv::split(','))
+    names.emplace_back(begin(v), end(v));
+  return names;
+}
+
+struct benchmark_statistics {
+  double median = 0;
+  double min    = 0;
+  double mean   = 0;
+  double stddev = 0;
+};
+
+inline benchmark_statistics statistics_of(std::vector<double> times) {
+  benchmark_statistics s;
+  if (times.empty())
+    return s;
+  stdr::sort(times);
+  auto n = size(times);
+  s.median = n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+  s.min    = times.front();
+  s.mean   = std::accumulate(begin(times), end(times), 0.0) / n;
+  double sq = 0;
+  for (auto t : times)
+    sq += (t - s.mean) * (t - s.mean);
+  s.stddev = n > 1 ? std::sqrt(sq / (n - 1)) : 0;
+  return s;
+}
+
+// Runs f warmup times and then times repetitions runs of it.
+benchmark_statistics measure(auto f, unsigned warmup, unsigned repetitions) {
+  for (unsigned w = 0; w < warmup; ++w)
+    f();
+  std::vector<double> times;
+  for (unsigned r = 0; r < repetitions; ++r) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto finish = std::chrono::steady_clock::now();
+    times.push_back(std::chrono::duration<double>(finish - start).count());
+  }
+  return statistics_of(std::move(times));
+}
+
+// The parameters of one row. bytes is the traffic of one run, what it reads
+// plus what it writes, from which the effective bandwidth is computed.
+struct benchmark_case {
+  std::string_view type;
+  std::uint64_t num_elements = 0;
+  std::uint32_t num_tiles = 0;
+  std::uint64_t bytes = 0;
+};
+
+enum class report_format {
+  csv,
+  json
+};
+
+// Quotes a CSV field if it contains a separator or a quote; benchmark names
+// often do, e.g. "f<a, b>".
+inline std::string csv_field(std::string_view field) {
+  if (field.find_first_of(",\"\n") == std::string_view::npos)
+    return std::string(field);
+  std::string quoted = "\"";
+  for (char c : field) {
+    if (c == '"')
+      quoted += '"';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+inline std::string json_string(std::string_view s) {
+  std::string quoted = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      quoted += '\\';
+    if (c == '\n')
+      quoted += "\\n";
+    else
+      quoted += c;
+  }
+  return quoted + "\"";
+}
+
+struct benchmark_harness {
+  report_format format = report_format::csv;
+  unsigned warmup = 1;
+  unsigned repetitions = 5;
+  std::ostream& os;
+  std::vector<std::pair<std::string, std::string>> context;
+  bool started = false;
+  bool first_row = true;
+
+  explicit benchmark_harness(std::ostream& os = std::cout) : os(os) {
+    if (auto env = std::getenv("THINK_PARALLEL_BENCHMARK_FORMAT"))
+      if (std::string_view(env) == "json")
+        format = report_format::json;
+    if (auto env = std::getenv("THINK_PARALLEL_BENCHMARK_WARMUP"))
+      warmup = unsigned(std::strtoul(env, nullptr, 10));
+    if (auto env = std::getenv("THINK_PARALLEL_BENCHMARK_REPETITIONS"))
+      repetitions = std::max(1U, unsigned(std::strtoul(env, nullptr, 10)));
+  }
+
+  benchmark_harness(benchmark_harness const&) = delete;
+  benchmark_harness& operator=(benchmark_harness const&) = delete;
+
+  ~benchmark_harness() {
+    start();
+    if (format == report_format::json)
+      os << "\n  ]\n}\n";
+    os.flush();
+#if THINK_PARALLEL_INSTRUMENT
+    if (auto path = std::getenv("THINK_PARALLEL_TRACE")) {
+      std::ofstream trace(path);
+      active_tile_trace().write_chrome_trace(trace);
+    }
+#endif
+  }
+
+  // Describes the whole run, e.g. the SIMD ISA. Only takes effect before
+  // the first benchmark.
+  void describe(std::string key, auto const& value) {
+    std::ostringstream ss;
+    ss << std::boolalpha << value;
+    context.emplace_back(std::move(key), ss.str());
+  }
+
+  // Times f and reports it as one row. Returns the result of the last run,
+  // if any, for the caller to validate.
+  auto run(std::string_view name, benchmark_case const& c, auto body) {
+    using R = decltype(body());
+
+#if THINK_PARALLEL_INSTRUMENT
+    // Record the tile loops of each run under this row's label.
+    auto label = std::string(name) + " (" + std::string(c.type) + ", "
+               + std::to_string(c.num_elements) + ")";
+    auto f = [&] {
+      active_tile_trace().begin_run(label);
+      return body();
+    };
+    struct end_run { ~end_run() { active_tile_trace().end_run(); } } trace_run;
+#else
+    auto& f = body;
+#endif
+
+    if constexpr (std::is_void_v<R>) {
+      report(name, c, measure(f, warmup, repetitions));
+    } else {
+      std::optional<R> result;
+      report(name, c, measure([&] { result.emplace(f()); },
+                              warmup, repetitions));
+      return std::move(*result);
+    }
+  }
+
+  void start() {
+    if (started)
+      return;
+    started = true;
+    if (format == report_format::json) {
+      os << "{\n  \"context\": {";
+      for (std::size_t i = 0; i < size(context); ++i)
+        os << (i ? ",\n    " : "\n    ") << json_string(context[i].first)
+           << ": " << json_string(context[i].second);
+      os << "\n  },\n  \"benchmarks\": [";
+    } else {
+      for (auto const& [key, value] : context)
+        os << "# " << csv_field(key) << ", " << csv_field(value) << "\n";
+      os << "Benchmark, Type, Number of Elements, Number of Tiles, "
+            "Median [s], Min [s], Stddev [s], GB/s, Elements/s\n";
+    }
+  }
+
+  void report(std::string_view name,
+              benchmark_case const& c,
+              benchmark_statistics const& s) {
+    start();
+    double gbs = s.median > 0 ? c.bytes / s.median / 1e9 : 0;
+    double eps = s.median > 0 ? c.num_elements / s.median : 0;
+    if (format == report_format::json) {
+      os << (first_row ? "\n" : ",\n")
+         << "    {\"name\": " << json_string(name)
+         << ", \"type\": " << json_string(c.type)
+         << ", \"num_elements\": " << c.num_elements
+         << ", \"num_tiles\": " << c.num_tiles
+         << ", \"repetitions\": " << repetitions
+         << ", \"median\": " << s.median
+         << ", \"min\": " << s.min
+         << ", \"mean\": " << s.mean
+         << ", \"stddev\": " << s.stddev
+         << ", \"bytes_per_second\": " << gbs * 1e9
+         << ", \"elements_per_second\": " << eps << "}";
+    } else {
+      os << csv_field(name) << ", " << csv_field(c.type) << ", "
+         << c.num_elements << ", " << c.num_tiles << ", "
+         << s.median << ", " << s.min << ", " << s.stddev << ", "
+         << gbs << ", " << eps << "\n";
+    }
+    first_row = false;
+  }
+};
+
+} // namespace think_parallel
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <think_parallel/simd.hpp>
+#include <think_parallel/predicates.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace think_parallel {
+
+// Each kernel returns a bitmask of the delimiters among the n <= 64 bytes at
+// first, bit k for first[k].
+
+template <std::size_t N>
+std::uint64_t delimiter_mask_scalar(char const* first, std::size_t n,
+                                    delimiter_set<N> const& op) {
+  std::uint64_t mask = 0;
+  for (std::size_t k = 0; k < n; ++k)
+    mask |= std::uint64_t(op.is_delimiter(first[k])) << k;
+  return mask;
+}
+
+#if THINK_PARALLEL_X86_SIMD
+
+template <std::size_t N>
+THINK_PARALLEL_TARGET_AVX2
+std::uint64_t delimiter_mask_avx2(char const* first, std::size_t n,
+                                  delimiter_set<N> const& op) {
+  if (n != 64)
+    return delimiter_mask_scalar(first, n, op);
+
+  auto lo = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(first));
+  auto hi = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(first + 32));
+  auto d_lo = _mm256_setzero_si256();
+  auto d_hi = _mm256_setzero_si256();
+  for (char d : op.delimiters) {
+    auto k = _mm256_set1_epi8(d);
+    d_lo = _mm256_or_si256(d_lo, _mm256_cmpeq_epi8(lo, k));
+    d_hi = _mm256_or_si256(d_hi, _mm256_cmpeq_epi8(hi, k));
+  }
+  return std::uint64_t(std::uint32_t(_mm256_movemask_epi8(d_lo)))
+       | std::uint64_t(std::uint32_t(_mm256_movemask_epi8(d_hi))) << 32;
+}
+
+template <std::size_t N>
+THINK_PARALLEL_TARGET_AVX512
+std::uint64_t delimiter_mask_avx512(char const* first, std::size_t n,
+                                    delimiter_set<N> const& op) {
+  __mmask64 valid = n >= 64 ? ~__mmask64(0) : (__mmask64(1) << n) - 1;
+  auto v = _mm512_maskz_loadu_epi8(valid, first);
+  __mmask64 mask = 0;
+  for (char d : op.delimiters)
+    mask |= _mm512_mask_cmpeq_epi8_mask(valid, v, _mm512_set1_epi8(d));
+  return mask;
+}
+
+#endif
+
+// Calls f(i, heads) for each block of up to 64 bytes in [b, e) of first,
+// where bit k of heads is set if first[i + k] begins a chunk: it is the
+// first byte, a delimiter, or follows one.
+template <simd_isa Isa, std::size_t N>
+void for_each_chunk_head_block(char const* first,
+                               std::size_t b, std::size_t e,
+                               delimiter_set<N> const& op,
+                               auto f) {
+  std::uint64_t carry = b == 0 || op.is_delimiter(first[b - 1]);
+  for (auto i = b; i < e; i += 64) {
+    auto n = std::min<std::size_t>(64, e - i);
+
+    std::uint64_t delims;
+#if THINK_PARALLEL_X86_SIMD
+    if constexpr (Isa == simd_isa::avx512)
+      delims = delimiter_mask_avx512(first + i, n, op);
+    else if constexpr (Isa == simd_isa::avx2)
+      delims = delimiter_mask_avx2(first + i, n, op);
+    else
+#endif
+      delims = delimiter_mask_scalar(first + i, n, op);
+
+    auto heads = delims | (delims << 1) | carry;
+    if (n < 64)
+      heads &= (std::uint64_t(1) << n) - 1;
+    carry = delims >> 63;
+
+    f(i, heads);
+  }
+}
+
+template <std::size_t N>
+void for_each_chunk_head_block(char const* first,
+                               std::size_t b, std::size_t e,
+                               delimiter_set<N> const& op,
+                               auto f) {
+#if THINK_PARALLEL_X86_SIMD
+  switch (active_simd_isa()) {
+    case simd_isa::avx512:
+      return for_each_chunk_head_block<simd_isa::avx512>(first, b, e, op, f);
+    case simd_isa::avx2:
+      return for_each_chunk_head_block<simd_isa::avx2>(first, b, e, op, f);
+    default:
+      break;
+  }
+#endif
+  for_each_chunk_head_block<simd_isa::scalar>(first, b, e, op, f);
+}
+
+} // namespace think_parallel
@@ -0,0 +1,469 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/scan_tile_state.hpp>
+#include <think_parallel/workspace.hpp>
+#include <think_parallel/executor.hpp>
+#include <think_parallel/tuning.hpp>
+#include <think_parallel/predicates.hpp>
+#include <think_parallel/chunk_boundaries.hpp>
+
+#include <ranges>
+#include <algorithm>
+#include <numeric>
+#include <execution>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <optional>
+#include <bit>
+#include <concepts>
+
+namespace think_parallel {
+
+template <typename Index = std::uint32_t>
+struct interval {
+  bool flag = true;
+  Index index = 0;
+  Index count = 0;
+  Index end = 0;
+};
+
+template <typename Index>
+interval<Index> operator+(interval<Index> l, interval<Index> r) {
+  return {r.flag,
+          l.index + r.index,
+          r.index ? r.count : l.count + r.count,
+          l.end + r.end};
+}
+
+template <typename Index = std::uint32_t>
+std::size_t chunk_by_three_pass_scratch_size(std::size_t n, std::uint32_t) {
+  return scratch_size_for<interval<Index>>(n + 1);
+}
+
+template <typename Index = std::uint32_t>
+auto chunk_by_three_pass(stdr::range auto&& in,
+                         stdr::range auto&& out,
+                         auto op,
+                         std::uint32_t num_tiles,
+                         workspace& ws) {
+  // An empty input has no chunks, and no tile to start the first one.
+  if (begin(in) == end(in))
+    return stdr::subrange(begin(out), begin(out));
+
+  ws.reset(chunk_by_three_pass_scratch_size<Index>(size(in), num_tiles));
+
+  auto intervals = ws.allocate<interval<Index>>(size(in) + 1);
+
+  intervals[0] = interval<Index>{true, 0, 1, 1};
+
+  auto adj_in = in | stdv::adjacent<2>;
+  std::transform(stde::par, begin(adj_in), end(adj_in), begin(intervals) + 1,
+    [&] (auto lr) { auto [l, r] = lr;
+      bool b = op(l, r);
+      return interval<Index>{b, !b, 1, 1};
+    });
+
+  intervals.back() = interval<Index>{false, 1, 1, 1};
+
+  std::inclusive_scan(stde::par,
+                      begin(intervals), end(intervals), begin(intervals));
+
+  auto adj_intervals = intervals | stdv::adjacent<2>;
+  std::for_each(stde::par, begin(adj_intervals), end(adj_intervals),
+    [&] (auto lr) { auto [l, r] = lr;
+      if (!r.flag)
+        out[l.index] = stdr::subrange(next(begin(in), l.end - l.count),
+                                      next(begin(in), l.end));
+    });
+
+  return stdr::subrange(begin(out), next(begin(out), intervals.back().index));
+}
+
+template <typename Index = std::uint32_t>
+auto chunk_by_three_pass(stdr::range auto&& in,
+                         stdr::range auto&& out,
+                         auto op,
+                         std::uint32_t num_tiles) {
+  workspace ws;
+  return chunk_by_three_pass<Index>(in, out, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+std::size_t chunk_by_decoupled_lookback_scratch_size(std::size_t,
+                                                     std::uint32_t num_tiles) {
+  return scan_tile_state<interval<Index>>::scratch_size(num_tiles);
+}
+
+template <typename Index = std::uint32_t>
+auto chunk_by_decoupled_lookback(executor auto&& exec,
+                                 stdr::range auto&& in,
+                                 stdr::range auto&& out,
+                                 auto op,
+                                 std::uint32_t num_tiles,
+                                 workspace& ws) {
+  // An empty input has no chunks, and no tile to start the first one.
+  if (begin(in) == end(in))
+    return stdr::subrange(begin(out), begin(out));
+
+  ws.reset(chunk_by_decoupled_lookback_scratch_size<Index>(size(in), num_tiles));
+
+  scan_tile_state<interval<Index>> sts(ws, num_tiles);
+
+  for_each_tile_in_order(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+
+      bool is_first_tile    = tile == 0;
+      bool is_last_tile     = tile == num_tiles - 1;
+      bool is_interior_tile = tile > 0 && tile < num_tiles - 1;
+
+      auto sub_in = range_for_tile(in, tile, num_tiles);
+
+      // Rounding the tile size up can leave trailing tiles empty. They add
+      // nothing, except that the last one still holds the trailing sentinel.
+      if (is_interior_tile && begin(sub_in) == end(sub_in)) {
+        sts.set_local_prefix(tile, interval<Index>{true, 0, 0, 0});
+        return;
+      }
+
+      if (!is_first_tile)
+        sub_in = stdr::subrange(--begin(sub_in), end(sub_in));
+
+      // A single tile needs both the leading and the trailing sentinel.
+      auto num_intervals = size(sub_in) - is_interior_tile
+                         + (is_first_tile && is_last_tile);
+
+      auto& tile_ws = tile_workspace();
+      tile_ws.reset(scratch_size_for<interval<Index>>(num_intervals));
+
+      auto intervals = tile_ws.allocate<interval<Index>>(num_intervals);
+
+      if (is_first_tile)
+        intervals[0] = interval<Index>{true, 0, 1, 1};
+
+      auto adj_in = sub_in | stdv::adjacent<2>;
+      std::transform(begin(adj_in), end(adj_in), begin(intervals) + is_first_tile,
+        [&] (auto lr) { auto [l, r] = lr;
+          bool b = op(l, r);
+          return interval<Index>{b, !b, 1, 1};
+        });
+
+      if (is_last_tile)
+        intervals.back() = interval<Index>{false, 1, 1, 1};
+
+      sts.set_local_prefix(tile,
+        *--std::inclusive_scan(begin(intervals), end(intervals),
+                               begin(intervals)));
+
+      // Writes the chunk that l, the prefix up to its last element, ends.
+      auto write_chunk = [&] (interval<Index> l) {
+        out[l.index] = stdr::subrange(next(begin(in), l.end - l.count),
+                                      next(begin(in), l.end));
+      };
+
+      if (!is_first_tile) {
+        auto pred = sts.wait_for_predecessor_prefix(tile);
+        stdr::for_each(intervals, [&] (auto& e) { e = pred + e; });
+
+        // The pair that straddles the boundary with the previous tile.
+        if (!intervals[0].flag)
+          write_chunk(pred);
+      }
+
+      auto adj_intervals = intervals | stdv::adjacent<2>;
+      std::for_each(begin(adj_intervals), end(adj_intervals),
+        [&] (auto lr) { auto [l, r] = lr;
+          if (!r.flag)
+            write_chunk(l);
+        });
+    });
+
+  return stdr::subrange(begin(out),
+    next(begin(out), sts.inclusive_prefix(num_tiles - 1).index));
+}
+
+template <typename Index = std::uint32_t>
+auto chunk_by_decoupled_lookback(stdr::range auto&& in,
+                                 stdr::range auto&& out,
+                                 auto op,
+                                 std::uint32_t num_tiles,
+                                 workspace& ws) {
+  return chunk_by_decoupled_lookback<Index>(
+    default_executor(), in, out, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+auto chunk_by_decoupled_lookback(stdr::range auto&& in,
+                                 stdr::range auto&& out,
+                                 auto op,
+                                 std::uint32_t num_tiles) {
+  workspace ws;
+  return chunk_by_decoupled_lookback<Index>(in, out, op, num_tiles, ws);
+}
+
+template <typename In, typename Op>
+inline constexpr bool is_simd_chunkable_v =
+     is_delimiter_predicate_v<Op>
+  && stdr::contiguous_range<In>
+  && std::same_as<stdr::range_value_t<In>, char>;
+
+// Calls f(i) for each chunk head i in the given tile of in, in order.
+void for_each_chunk_head_in_tile(stdr::range auto&& in,
+                                 auto op,
+                                 std::uint32_t tile,
+                                 std::uint32_t num_tiles,
+                                 auto f) {
+  auto first = begin(in);
+  auto sub_in = range_for_tile(in, tile, num_tiles);
+  auto b = std::size_t(distance(first, begin(sub_in)));
+  auto e = std::size_t(distance(first, end(sub_in)));
+  if constexpr (is_simd_chunkable_v<decltype(in), decltype(op)>) {
+    for_each_chunk_head_block(stdr::data(in), b, e, op,
+      [&] (std::size_t i, std::uint64_t heads) {
+        for (; heads != 0; heads &= heads - 1)
+          f(i + std::countr_zero(heads));
+      });
+  } else {
+    for (auto i = b; i < e; ++i)
+      if (i == 0 || !op(first[i - 1], first[i]))
+        f(i);
+  }
+}
+
+// Number of chunks that start in the given tile of in.
+template <typename Index = std::uint32_t>
+Index chunk_by_heads_in_tile(stdr::range auto&& in,
+                             auto op,
+                             std::uint32_t tile,
+                             std::uint32_t num_tiles) {
+  Index count = 0;
+  if constexpr (is_simd_chunkable_v<decltype(in), decltype(op)>) {
+    auto sub_in = range_for_tile(in, tile, num_tiles);
+    auto b = std::size_t(distance(begin(in), begin(sub_in)));
+    auto e = std::size_t(distance(begin(in), end(sub_in)));
+    for_each_chunk_head_block(stdr::data(in), b, e, op,
+      [&] (std::size_t, std::uint64_t heads) { count += std::popcount(heads); });
+  } else {
+    for_each_chunk_head_in_tile(in, op, tile, num_tiles,
+      [&] (std::size_t) { ++count; });
+  }
+  return count;
+}
+
+template <typename Index = std::uint32_t>
+Index chunk_by_count(executor auto&& exec,
+                     stdr::range auto&& in,
+                     auto op,
+                     std::uint32_t num_tiles) {
+  std::atomic<Index> count(0);
+  for_each_tile(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+      count.fetch_add(chunk_by_heads_in_tile<Index>(in, op, tile, num_tiles),
+                      std::memory_order_relaxed);
+    });
+  return count.load(std::memory_order_relaxed);
+}
+
+template <typename Index = std::uint32_t>
+Index chunk_by_count(stdr::range auto&& in,
+                     auto op,
+                     std::uint32_t num_tiles) {
+  return chunk_by_count<Index>(default_executor(), in, op, num_tiles);
+}
+
+template <typename Index = std::uint32_t>
+std::size_t chunk_by_offsets_scratch_size(std::size_t, std::uint32_t num_tiles) {
+  return scratch_size_for<Index>(num_tiles);
+}
+
+// The start offset of every chunk followed by size(in), in a buffer of
+// exactly chunk count + 1 elements: chunk k is [offsets[k], offsets[k + 1]).
+// One pass counts the chunk heads of each tile, a second writes them.
+template <typename Index = std::uint32_t>
+std::vector<Index> chunk_by_offsets(executor auto&& exec,
+                                    stdr::range auto&& in,
+                                    auto op,
+                                    std::uint32_t num_tiles,
+                                    workspace& ws) {
+  ws.reset(chunk_by_offsets_scratch_size<Index>(size(in), num_tiles));
+
+  auto tile_offsets = ws.allocate<Index>(num_tiles);
+
+  for_each_tile(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+      tile_offsets[tile] = chunk_by_heads_in_tile<Index>(in, op, tile, num_tiles);
+    });
+
+  auto num_chunks = tile_offsets.back();
+  std::exclusive_scan(begin(tile_offsets), end(tile_offsets),
+                      begin(tile_offsets), Index(0));
+  num_chunks += tile_offsets.back();
+
+  std::vector<Index> offsets(num_chunks + 1);
+  offsets.back() = Index(size(in));
+
+  for_each_tile(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+      auto o = tile_offsets[tile];
+      for_each_chunk_head_in_tile(in, op, tile, num_tiles,
+        [&] (std::size_t i) { offsets[o++] = Index(i); });
+    });
+
+  return offsets;
+}
+
+template <typename Index = std::uint32_t>
+std::vector<Index> chunk_by_offsets(stdr::range auto&& in,
+                                    auto op,
+                                    std::uint32_t num_tiles,
+                                    workspace& ws) {
+  return chunk_by_offsets<Index>(default_executor(), in, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+std::vector<Index> chunk_by_offsets(stdr::range auto&& in,
+                                    auto op,
+                                    std::uint32_t num_tiles) {
+  workspace ws;
+  return chunk_by_offsets<Index>(in, op, num_tiles, ws);
+}
+
+// Calls f(chunk) in parallel for every chunk of in without storing any of
+// them. The tile holding a chunk's head hands it over, reading past its own
+// end to find where the last one stops. Chunks are visited in no
+// particular order.
+void chunk_by_for_each(executor auto&& exec,
+                       stdr::range auto&& in,
+                       auto op,
+                       auto f,
+                       std::uint32_t num_tiles) {
+  for_each_tile(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+      auto first = begin(in);
+      auto n = std::size_t(size(in));
+
+      std::optional<std::size_t> head;
+      for_each_chunk_head_in_tile(in, op, tile, num_tiles,
+        [&] (std::size_t i) {
+          if (head)
+            f(stdr::subrange(next(first, *head), next(first, i)));
+          head = i;
+        });
+
+      if (head) {
+        auto sub_in = range_for_tile(in, tile, num_tiles);
+        auto j = std::size_t(distance(first, end(sub_in)));
+        while (j < n && op(first[j - 1], first[j]))
+          ++j;
+        f(stdr::subrange(next(first, *head), next(first, j)));
+      }
+    });
+}
+
+void chunk_by_for_each(stdr::range auto&& in,
+                       auto op,
+                       auto f,
+                       std::uint32_t num_tiles) {
+  chunk_by_for_each(default_executor(), in, op, f, num_tiles);
+}
+
+auto chunk_by_serial(stdr::range auto&& in,
+                     stdr::range auto&& out,
+                     auto op) {
+  auto first = begin(in);
+  std::size_t count = 0, head = 0;
+  for_each_chunk_head_in_tile(in, op, 0, 1,
+    [&] (std::size_t i) {
+      if (i != 0)
+        out[count++] = stdr::subrange(next(first, head), next(first, i));
+      head = i;
+    });
+  if (begin(in) != end(in))
+    out[count++] = stdr::subrange(next(first, head), next(first, size(in)));
+  return stdr::subrange(begin(out), next(begin(out), count));
+}
+
+// Picks the tile count and the algorithm from the input size and the active
+// tuning: a serial chunk_by for small inputs, the three-pass algorithm for
+// medium ones and decoupled lookback for large ones.
+template <typename Index = std::uint32_t>
+auto chunk_by_auto(executor auto&& exec,
+                   stdr::range auto&& in,
+                   stdr::range auto&& out,
+                   auto op,
+                   workspace& ws) {
+  using T = stdr::range_value_t<decltype(in)>;
+
+  auto const& t = active_tuning();
+  auto num_tiles = auto_num_tiles(size(in), sizeof(T), t);
+
+  switch (t.chunk_by.tier_for(size(in) * sizeof(T))) {
+    case algorithm_tier::serial:
+      return chunk_by_serial(in, out, op);
+    case algorithm_tier::multi_pass:
+      return chunk_by_three_pass<Index>(in, out, op, num_tiles, ws);
+    default:
+      return chunk_by_decoupled_lookback<Index>(exec, in, out, op, num_tiles, ws);
+  }
+}
+
+template <typename Index = std::uint32_t>
+auto chunk_by_auto(stdr::range auto&& in,
+                   stdr::range auto&& out,
+                   auto op,
+                   workspace& ws) {
+  return chunk_by_auto<Index>(default_executor(), in, out, op, ws);
+}
+
+template <typename Index = std::uint32_t>
+auto chunk_by_auto(stdr::range auto&& in,
+                   stdr::range auto&& out,
+                   auto op) {
+  workspace ws;
+  return chunk_by_auto<Index>(in, out, op, ws);
+}
+
+// A chunk_by over a sequence of blocks. The open chunk, the one still
+// running at the end of the previous block, is carried as its global start
+// offset together with the block's last element, against which the next
+// block's first element is compared.
+template <typename T, typename Op, typename Index = std::uint64_t>
+struct chunk_by_stream {
+  Op op;
+  std::uint32_t num_tiles;
+  Index position = 0;
+  Index open_chunk = 0;
+  std::optional<T> last;
+  workspace ws;
+
+  chunk_by_stream(Op op, std::uint32_t num_tiles)
+    : op(op), num_tiles(num_tiles) {}
+
+  // Returns the global start offset of every chunk that begins in this
+  // block. Chunk k ends where chunk k + 1 begins; the last one stays open
+  // until a later block starts another, or ends at position.
+  std::vector<Index> operator()(stdr::range auto&& in) {
+    if (begin(in) == end(in))
+      return {};
+
+    auto offsets = chunk_by_offsets<Index>(in, op, num_tiles, ws);
+    offsets.pop_back();
+
+    bool continues = last && op(*last, *begin(in));
+    if (continues)
+      offsets.erase(begin(offsets));
+
+    for (auto& o : offsets)
+      o += position;
+
+    if (!offsets.empty())
+      open_chunk = offsets.back();
+
+    position += Index(size(in));
+    last = *next(begin(in), size(in) - 1);
+    return offsets;
+  }
+};
+
+} // namespace think_parallel
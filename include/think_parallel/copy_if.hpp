@@ -0,0 +1,330 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/scan_tile_state.hpp>
+#include <think_parallel/workspace.hpp>
+#include <think_parallel/executor.hpp>
+#include <think_parallel/tuning.hpp>
+#include <think_parallel/predicates.hpp>
+#include <think_parallel/stream_compaction.hpp>
+
+#include <ranges>
+#include <algorithm>
+#include <numeric>
+#include <execution>
+#include <atomic>
+#include <bit>
+#include <utility>
+#include <iterator>
+#include <memory>
+
+namespace think_parallel {
+
+template <typename Index = std::uint32_t>
+std::size_t copy_if_three_pass_scratch_size(std::size_t n, std::uint32_t) {
+  return scratch_size_for<std::uint8_t>(n)
+       + scratch_size_for<Index>(n + 1);
+}
+
+template <typename Index = std::uint32_t>
+auto copy_if_three_pass(stdr::range auto&& in,
+                        auto out,
+                        auto op,
+                        std::uint32_t num_tiles,
+                        workspace& ws) {
+  ws.reset(copy_if_three_pass_scratch_size<Index>(size(in), num_tiles));
+
+  auto flags = ws.allocate<std::uint8_t>(size(in));
+
+  std::transform(stde::par, begin(in), end(in), begin(flags), op);
+
+  auto indices = ws.allocate<Index>(size(in) + 1);
+  indices[0] = 0;
+
+  auto flags_as_index = flags
+                      | stdv::transform([] (auto b)
+                                        { return Index(b); });
+  std::inclusive_scan(stde::par,
+                      begin(flags_as_index), end(flags_as_index),
+                      begin(indices) + 1);
+
+  auto zipped = stdv::zip(in, flags, indices);
+  std::for_each(stde::par, begin(zipped), end(zipped),
+    [&] (auto z) { auto [e, flag, index] = z;
+      if (flag) out[index] = e;
+    });
+
+  return stdr::subrange(out, next(out, indices.back()));
+}
+
+template <typename Index = std::uint32_t>
+auto copy_if_three_pass(stdr::range auto&& in,
+                        auto out,
+                        auto op,
+                        std::uint32_t num_tiles) {
+  workspace ws;
+  return copy_if_three_pass<Index>(in, out, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+std::size_t copy_if_decoupled_lookback_scratch_size(std::size_t,
+                                                    std::uint32_t num_tiles) {
+  return scan_tile_state<Index>::scratch_size(num_tiles);
+}
+
+template <typename Index = std::uint32_t>
+auto copy_if_decoupled_lookback(executor auto&& exec,
+                                stdr::range auto&& in,
+                                auto out,
+                                auto op,
+                                std::uint32_t num_tiles,
+                                workspace& ws) {
+  ws.reset(copy_if_decoupled_lookback_scratch_size<Index>(size(in), num_tiles));
+
+  scan_tile_state<Index> sts(ws, num_tiles);
+
+  for_each_tile_in_order(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+
+      auto sub_in = range_for_tile(in, tile, num_tiles);
+
+      auto& tile_ws = tile_workspace();
+      tile_ws.reset(scratch_size_for<std::uint8_t>(size(sub_in))
+                  + scratch_size_for<Index>(size(sub_in) + 1));
+
+      auto flags = tile_ws.allocate<std::uint8_t>(size(sub_in));
+      stdr::transform(sub_in, begin(flags), op);
+
+      auto indices = tile_ws.allocate<Index>(size(sub_in) + 1);
+      indices[0] = 0;
+
+      auto flags_as_index = flags
+                          | stdv::transform([] (auto b)
+                                            { return Index(b); });
+      sts.set_local_prefix(tile,
+        *--std::inclusive_scan(begin(flags_as_index), end(flags_as_index),
+                               begin(indices) + 1));
+
+      if (tile != 0) {
+        auto pred = sts.wait_for_predecessor_prefix(tile);
+        stdr::for_each(indices, [&] (auto& e) { e = pred + e; });
+      }
+
+      stdr::for_each(stdv::zip(sub_in, flags, indices),
+        [&] (auto z) { auto [e, flag, index] = z;
+          if (flag) out[index] = e;
+        });
+    });
+
+  return stdr::subrange(out, next(out, sts.inclusive_prefix(num_tiles - 1)));
+}
+
+template <typename Index = std::uint32_t>
+auto copy_if_decoupled_lookback(stdr::range auto&& in,
+                                auto out,
+                                auto op,
+                                std::uint32_t num_tiles,
+                                workspace& ws) {
+  return copy_if_decoupled_lookback<Index>(
+    default_executor(), in, out, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+auto copy_if_decoupled_lookback(stdr::range auto&& in,
+                                auto out,
+                                auto op,
+                                std::uint32_t num_tiles) {
+  workspace ws;
+  return copy_if_decoupled_lookback<Index>(in, out, op, num_tiles, ws);
+}
+
+// How copy_if_fused recovers the predicate results in its write phase:
+// reevaluate calls op again, bitmask replays a per-tile bitmask recorded
+// while counting. automatic uses the vectorized compaction kernels when the
+// input and output are contiguous int32 and op is a compare_with predicate,
+// bitmask for predicates marked with is_expensive_predicate_v, and
+// reevaluate otherwise.
+enum class predicate_evaluation {
+  automatic,
+  reevaluate,
+  bitmask
+};
+
+template <typename Op>
+inline constexpr bool is_expensive_predicate_v = false;
+
+template <typename Op>
+struct expensive_predicate {
+  Op op;
+
+  constexpr decltype(auto) operator()(auto&&... args) const {
+    return op(std::forward<decltype(args)>(args)...);
+  }
+};
+
+template <typename Op>
+inline constexpr bool is_expensive_predicate_v<expensive_predicate<Op>> = true;
+
+template <typename Index = std::uint32_t>
+std::size_t copy_if_fused_scratch_size(std::size_t, std::uint32_t num_tiles) {
+  return scan_tile_state<Index>::scratch_size(num_tiles);
+}
+
+template <typename Index = std::uint32_t,
+          predicate_evaluation Eval = predicate_evaluation::automatic>
+auto copy_if_fused(executor auto&& exec,
+                   stdr::range auto&& in,
+                   auto out,
+                   auto op,
+                   std::uint32_t num_tiles,
+                   workspace& ws) {
+  constexpr bool use_simd =
+    Eval == predicate_evaluation::automatic
+    && is_simd_compactable_v<decltype(op), stdr::range_value_t<decltype(in)>>
+    && stdr::contiguous_range<decltype(in)>
+    && std::contiguous_iterator<decltype(out)>
+    && std::same_as<std::iter_value_t<decltype(out)>, std::int32_t>;
+
+  constexpr bool use_bitmask =
+    Eval == predicate_evaluation::bitmask
+    || (Eval == predicate_evaluation::automatic
+        && !use_simd
+        && is_expensive_predicate_v<decltype(op)>);
+
+  ws.reset(copy_if_fused_scratch_size<Index>(size(in), num_tiles));
+
+  scan_tile_state<Index> sts(ws, num_tiles);
+
+  for_each_tile_in_order(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+
+      auto sub_in = range_for_tile(in, tile, num_tiles);
+      auto first  = begin(sub_in);
+      auto n      = size(sub_in);
+
+      Index count = 0;
+      std::span<std::uint64_t> mask;
+
+      if constexpr (use_simd) {
+        count = count_if_simd(stdr::data(sub_in), n, op);
+      } else if constexpr (use_bitmask) {
+        auto& tile_ws = tile_workspace();
+        tile_ws.reset(scratch_size_for<std::uint64_t>((n + 63) / 64));
+        mask = tile_ws.allocate<std::uint64_t>((n + 63) / 64);
+
+        for (std::size_t w = 0; w < size(mask); ++w) {
+          std::uint64_t bits = 0;
+          auto last = std::min<std::size_t>(64, n - w * 64);
+          for (std::size_t b = 0; b < last; ++b)
+            bits |= std::uint64_t(bool(op(first[w * 64 + b]))) << b;
+          mask[w] = bits;
+          count += std::popcount(bits);
+        }
+      } else {
+        for (auto&& e : sub_in)
+          count += bool(op(e));
+      }
+
+      sts.set_local_prefix(tile, count);
+
+      Index index = tile != 0 ? sts.wait_for_predecessor_prefix(tile) : 0;
+
+      if constexpr (use_simd) {
+        copy_if_simd(stdr::data(sub_in), n, std::to_address(out) + index, op);
+      } else if constexpr (use_bitmask) {
+        for (std::size_t w = 0; w < size(mask); ++w)
+          for (auto bits = mask[w]; bits != 0; bits &= bits - 1)
+            out[index++] = first[w * 64 + std::countr_zero(bits)];
+      } else {
+        for (auto&& e : sub_in)
+          if (op(e))
+            out[index++] = e;
+      }
+    });
+
+  return stdr::subrange(out, next(out, sts.inclusive_prefix(num_tiles - 1)));
+}
+
+template <typename Index = std::uint32_t,
+          predicate_evaluation Eval = predicate_evaluation::automatic>
+auto copy_if_fused(stdr::range auto&& in,
+                   auto out,
+                   auto op,
+                   std::uint32_t num_tiles,
+                   workspace& ws) {
+  return copy_if_fused<Index, Eval>(
+    default_executor(), in, out, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t,
+          predicate_evaluation Eval = predicate_evaluation::automatic>
+auto copy_if_fused(stdr::range auto&& in,
+                   auto out,
+                   auto op,
+                   std::uint32_t num_tiles) {
+  workspace ws;
+  return copy_if_fused<Index, Eval>(in, out, op, num_tiles, ws);
+}
+
+// Picks the tile count and the algorithm from the input size and the active
+// tuning: a serial copy_if for small inputs, the three-pass algorithm for
+// medium ones and the fused one for large ones.
+template <typename Index = std::uint32_t>
+auto copy_if_auto(executor auto&& exec,
+                  stdr::range auto&& in,
+                  auto out,
+                  auto op,
+                  workspace& ws) {
+  using T = stdr::range_value_t<decltype(in)>;
+
+  auto const& t = active_tuning();
+  auto num_tiles = auto_num_tiles(size(in), sizeof(T), t);
+
+  switch (t.copy_if.tier_for(size(in) * sizeof(T))) {
+    case algorithm_tier::serial:
+      return stdr::subrange(out, stdr::copy_if(in, out, op).out);
+    case algorithm_tier::multi_pass:
+      return copy_if_three_pass<Index>(in, out, op, num_tiles, ws);
+    default:
+      return copy_if_fused<Index>(exec, in, out, op, num_tiles, ws);
+  }
+}
+
+template <typename Index = std::uint32_t>
+auto copy_if_auto(stdr::range auto&& in,
+                  auto out,
+                  auto op,
+                  workspace& ws) {
+  return copy_if_auto<Index>(default_executor(), in, out, op, ws);
+}
+
+template <typename Index = std::uint32_t>
+auto copy_if_auto(stdr::range auto&& in,
+                  auto out,
+                  auto op) {
+  workspace ws;
+  return copy_if_auto<Index>(in, out, op, ws);
+}
+
+// A copy_if over a sequence of blocks into one output; count is the number
+// of elements selected so far, i.e. where the next block's output starts.
+template <typename Op, typename Index = std::uint64_t>
+struct copy_if_stream {
+  Op op;
+  std::uint32_t num_tiles;
+  Index count = 0;
+  workspace ws;
+
+  copy_if_stream(Op op, std::uint32_t num_tiles)
+    : op(op), num_tiles(num_tiles) {}
+
+  // out is the start of the whole output, the same for every block. Returns
+  // the selected elements of this block, written at next(out, count).
+  auto operator()(stdr::range auto&& in, auto out) {
+    auto selected = copy_if_fused<Index>(in, next(out, count), op, num_tiles, ws);
+    count += Index(size(selected));
+    return selected;
+  }
+};
+
+} // namespace think_parallel
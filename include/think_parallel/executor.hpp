@@ -0,0 +1,423 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/scan_tile_state.hpp>
+#include <think_parallel/instrument.hpp>
+
+#include <ranges>
+#include <algorithm>
+#include <execution>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <concepts>
+#include <cstdint>
+#include <type_traits>
+
+#include <string_view>
+
+#if defined(__linux__)
+  #include <pthread.h>
+  #include <sched.h>
+#endif
+
+// The backend behind default_executor(), chosen at build time with
+// -DTHINK_PARALLEL_BACKEND=THINK_PARALLEL_BACKEND_<NAME>: the standard
+// parallel algorithms (TBB with libstdc++, the default), OpenMP, the calling
+// thread alone, or the built-in thread pool.
+#define THINK_PARALLEL_BACKEND_TBB    0
+#define THINK_PARALLEL_BACKEND_OPENMP 1
+#define THINK_PARALLEL_BACKEND_SERIAL 2
+#define THINK_PARALLEL_BACKEND_POOL   3
+
+#ifndef THINK_PARALLEL_BACKEND
+  #define THINK_PARALLEL_BACKEND THINK_PARALLEL_BACKEND_TBB
+#endif
+
+#if THINK_PARALLEL_BACKEND == THINK_PARALLEL_BACKEND_OPENMP && !defined(_OPENMP)
+  #error "THINK_PARALLEL_BACKEND_OPENMP requires compiling with OpenMP"
+#endif
+
+namespace think_parallel {
+
+// An executor runs f(i) for every i in [0, n) and returns once all calls
+// have finished. As with the standard parallel algorithms, an exception
+// escaping f calls std::terminate.
+//
+// Decoupled lookback needs every tile below a running one to have been
+// started too. Executors that start indices in increasing order within each
+// of their queues say so with a bulk_in_order member; for the others,
+// for_each_tile_in_order hands out tiles through a counter.
+template <typename E>
+concept executor = requires (std::remove_cvref_t<E>& e, void (*f)(std::uint32_t)) {
+  e.bulk(std::uint32_t(0), f);
+};
+
+// Forks onto the standard library's parallel backend on every call.
+struct par_executor {
+  void bulk(std::uint32_t n, auto f) const {
+    auto indices = stdv::iota(0U, n);
+    std::for_each(stde::par, begin(indices), end(indices), f);
+  }
+};
+
+// Runs every index on the calling thread, in increasing order.
+struct sequential_executor {
+  void bulk(std::uint32_t n, auto f) const {
+    for (std::uint32_t i = 0; i < n; ++i)
+      f(i);
+  }
+
+  void bulk_in_order(std::uint32_t n, auto f) const {
+    bulk(n, f);
+  }
+};
+
+#if defined(_OPENMP)
+// Runs f in an OpenMP parallel region, handing out one index at a time.
+// OpenMP does not promise the order in which the chunks start, so this has
+// no bulk_in_order.
+struct openmp_executor {
+  void bulk(std::uint32_t n, auto f) const {
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (std::int64_t i = 0; i < std::int64_t(n); ++i)
+      f(std::uint32_t(i));
+  }
+};
+#endif
+
+// A persistent pool of worker threads, each pinned to its own CPU where the
+// platform allows it. bulk publishes a job that the workers and the calling
+// thread drain together; idle workers spin on the job generation for a
+// while before they block, so back-to-back calls skip the wakeup. Calls
+// from inside a job run inline.
+//
+// Up to max_jobs calls from different threads run at once: each takes a job
+// slot, and the workers drain every open slot, so the indices of independent
+// jobs interleave on the same workers. Further calls wait for a free slot.
+// A calling thread only runs indices of its own job; an index of another
+// job may wait in lookback on that job's other indices, and would hold the
+// caller up long after its own job has finished.
+//
+// The workers may be grouped into nodes, e.g. NUMA nodes. A job's indices
+// are then dealt out to the nodes round-robin in chunks of chunk_size
+// consecutive indices, so that every node works near the start of the job
+// at once, and each worker drains its own node's queue before it helps
+// with the others. The node an index belongs to depends only on the index
+// and the pool, not on the schedule; the thread that runs it does not, since
+// the calling thread, which is not pinned, drains node 0's queue, and any
+// worker may help with another node's queue.
+struct thread_pool {
+  static constexpr std::uint32_t spin_limit = 1 << 16;
+  static constexpr std::uint32_t max_jobs   = 8;
+
+  struct alignas(cache_line_size) queue {
+    std::atomic<std::uint32_t> next = 0;
+    std::uint32_t end = 0;
+  };
+
+  struct job_slot {
+    std::unique_ptr<queue[]> queues;
+    void (*invoke)(void const*, std::uint32_t) = nullptr;
+    void const* job = nullptr;
+    alignas(cache_line_size) std::atomic<std::uint32_t> pending = 0;
+    alignas(cache_line_size) std::atomic<std::uint32_t> active = 0;
+    std::atomic<bool> open = false;
+    bool taken = false;
+  };
+
+  std::vector<std::jthread> workers;
+  std::unique_ptr<job_slot[]> slots;
+  std::uint32_t num_nodes = 1;
+  std::uint32_t chunk_size = 1;
+
+  std::mutex submit;
+  std::condition_variable slot_freed;
+
+  std::atomic<std::uint32_t> sleeping = 0;
+  std::atomic<std::uint64_t> generation = 0;
+  std::atomic<bool> stop = false;
+
+  static bool& inside_job() {
+    thread_local bool inside = false;
+    return inside;
+  }
+
+  // num_threads counts the calling thread, which always takes part.
+  explicit thread_pool(unsigned num_threads = std::thread::hardware_concurrency()) {
+    init_slots();
+    auto cpus = allowed_cpus();
+    for (unsigned w = 1; w < num_threads; ++w) {
+      workers.emplace_back([this] { work(0); });
+      if (!cpus.empty())
+        pin(workers.back(), cpus[w % cpus.size()]);
+    }
+  }
+
+  // One worker per CPU of each node; the calling thread takes the place of
+  // the first CPU of node 0. Each chunk has one index per CPU of the
+  // largest node.
+  explicit thread_pool(std::vector<std::vector<unsigned>> const& node_cpus)
+    : num_nodes(std::uint32_t(std::max<std::size_t>(node_cpus.size(), 1))) {
+    for (auto const& cpus : node_cpus)
+      chunk_size = std::max(chunk_size, std::uint32_t(cpus.size()));
+    init_slots();
+    for (std::uint32_t node = 0; node < node_cpus.size(); ++node)
+      for (std::size_t c = node == 0; c < node_cpus[node].size(); ++c) {
+        workers.emplace_back([this, node] { work(node); });
+        pin(workers.back(), node_cpus[node][c]);
+      }
+  }
+
+  thread_pool(thread_pool const&) = delete;
+  thread_pool& operator=(thread_pool const&) = delete;
+
+  ~thread_pool() {
+    stop.store(true, std::memory_order_seq_cst);
+    generation.fetch_add(1, std::memory_order_seq_cst);
+    generation.notify_all();
+    workers.clear();
+  }
+
+  void init_slots() {
+    slots = std::make_unique<job_slot[]>(max_jobs);
+    for (std::uint32_t j = 0; j < max_jobs; ++j)
+      slots[j].queues = std::make_unique<queue[]>(num_nodes);
+  }
+
+  std::uint32_t size() const {
+    return std::uint32_t(workers.size()) + 1;
+  }
+
+  // The number of indices of a job of n indices that belong to node.
+  std::uint32_t node_size(std::uint32_t node, std::uint32_t n) const {
+    auto round = std::uint64_t(chunk_size) * num_nodes;
+    auto rest  = n % round;
+    auto first = std::uint64_t(node) * chunk_size;
+    return std::uint32_t(n / round * chunk_size
+                         + (rest > first ? std::min<std::uint64_t>(chunk_size, rest - first) : 0));
+  }
+
+  // The index at position p of node's queue.
+  std::uint32_t node_index(std::uint32_t node, std::uint32_t p) const {
+    return (p / chunk_size * num_nodes + node) * chunk_size + p % chunk_size;
+  }
+
+  // Every queue hands out its indices in increasing order.
+  void bulk_in_order(std::uint32_t n, auto f) {
+    bulk(n, f);
+  }
+
+  void bulk(std::uint32_t n, auto f) {
+    if (n == 0)
+      return;
+
+    if (workers.empty() || inside_job()) {
+      for (std::uint32_t i = 0; i < n; ++i)
+        f(i);
+      return;
+    }
+
+    job_slot* slot = nullptr;
+    {
+      std::unique_lock lock(submit);
+      slot_freed.wait(lock, [&] {
+        for (std::uint32_t j = 0; j < max_jobs && !slot; ++j)
+          if (!slots[j].taken)
+            slot = &slots[j];
+        return slot != nullptr;
+      });
+      slot->taken = true;
+    }
+
+    slot->invoke = [] (void const* job, std::uint32_t i) {
+      (*static_cast<decltype(f) const*>(job))(i);
+    };
+    slot->job = &f;
+    for (std::uint32_t node = 0; node < num_nodes; ++node) {
+      slot->queues[node].next.store(0, std::memory_order_relaxed);
+      slot->queues[node].end = node_size(node, n);
+    }
+    slot->pending.store(n, std::memory_order_relaxed);
+    slot->open.store(true, std::memory_order_seq_cst);
+
+    // Pairs with the increment of sleeping in work, as in scan_tile_state.
+    generation.fetch_add(1, std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_seq_cst) != 0)
+      generation.notify_all();
+
+    // Run our own indices, then wait for the workers to finish the rest.
+    inside_job() = true;
+    drain(*slot, 0);
+    for (std::uint32_t spins = 0;
+         slot->pending.load(std::memory_order_acquire) != 0; )
+      if (spins++ < spin_limit)
+        spin_pause();
+      else
+        std::this_thread::yield();
+    inside_job() = false;
+
+    // No thread may still be reading this job when the slot is reused. Once
+    // the slot is closed, workers no longer enter it, so active only falls.
+    slot->open.store(false, std::memory_order_seq_cst);
+    while (slot->active.load(std::memory_order_seq_cst) != 0)
+      spin_pause();
+
+    {
+      std::lock_guard lock(submit);
+      slot->taken = false;
+    }
+    slot_freed.notify_one();
+  }
+
+  // Runs indices of slot's job until its queues are empty; returns whether
+  // it ran any.
+  bool drain(job_slot& slot, std::uint32_t home) {
+    bool ran = false;
+    for (std::uint32_t k = 0; k < num_nodes; ++k) {
+      auto node = (home + k) % num_nodes;
+      auto& q = slot.queues[node];
+      for (;;) {
+        auto p = q.next.fetch_add(1, std::memory_order_relaxed);
+        if (p >= q.end)
+          break;
+        slot.invoke(slot.job, node_index(node, p));
+        slot.pending.fetch_sub(1, std::memory_order_acq_rel);
+        ran = true;
+      }
+    }
+    return ran;
+  }
+
+  bool drain_open_jobs(std::uint32_t home) {
+    bool ran = false;
+    for (std::uint32_t j = 0; j < max_jobs; ++j) {
+      auto& slot = slots[j];
+      // Closed slots are skipped without touching active, so a closing bulk
+      // only waits for the drainers already inside.
+      if (!slot.open.load(std::memory_order_relaxed))
+        continue;
+      // Pairs with the closing of the slot in bulk: either bulk sees us
+      // active and waits, or we see the slot closed and leave it alone.
+      slot.active.fetch_add(1, std::memory_order_seq_cst);
+      if (slot.open.load(std::memory_order_seq_cst))
+        ran |= drain(slot, home);
+      slot.active.fetch_sub(1, std::memory_order_release);
+    }
+    return ran;
+  }
+
+  void work(std::uint32_t home) {
+    inside_job() = true;
+    for (;;) {
+      // Read the generation before looking at the slots, so that a job
+      // published after the scan still wakes us.
+      auto seen = generation.load(std::memory_order_seq_cst);
+      if (stop.load(std::memory_order_relaxed))
+        return;
+
+      if (drain_open_jobs(home))
+        continue;
+
+      std::uint32_t spins = 0;
+      while (generation.load(std::memory_order_acquire) == seen) {
+        if (spins++ < spin_limit) {
+          spin_pause();
+        } else {
+          sleeping.fetch_add(1, std::memory_order_seq_cst);
+          generation.wait(seen, std::memory_order_seq_cst);
+          sleeping.fetch_sub(1, std::memory_order_relaxed);
+        }
+      }
+    }
+  }
+
+  static std::vector<unsigned> allowed_cpus() {
+    std::vector<unsigned> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+      for (unsigned c = 0; c < CPU_SETSIZE; ++c)
+        if (CPU_ISSET(c, &set))
+          cpus.push_back(c);
+#endif
+    return cpus;
+  }
+
+  static void pin([[maybe_unused]] std::jthread& t, [[maybe_unused]] unsigned cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#endif
+  }
+};
+
+// A process-wide pool with one thread per hardware thread, started on
+// first use.
+inline thread_pool& default_thread_pool() {
+  static thread_pool pool;
+  return pool;
+}
+
+// Runs f on the given pool; a cheap handle that can be passed by value.
+struct pool_executor {
+  thread_pool* pool = &default_thread_pool();
+
+  void bulk(std::uint32_t n, auto f) const {
+    pool->bulk(n, f);
+  }
+
+  void bulk_in_order(std::uint32_t n, auto f) const {
+    pool->bulk_in_order(n, f);
+  }
+};
+
+#if THINK_PARALLEL_BACKEND == THINK_PARALLEL_BACKEND_OPENMP
+inline openmp_executor default_executor() {
+  return {};
+}
+inline constexpr std::string_view backend_name = "openmp";
+#elif THINK_PARALLEL_BACKEND == THINK_PARALLEL_BACKEND_SERIAL
+inline sequential_executor default_executor() {
+  return {};
+}
+inline constexpr std::string_view backend_name = "serial";
+#elif THINK_PARALLEL_BACKEND == THINK_PARALLEL_BACKEND_POOL
+inline pool_executor default_executor() {
+  return {};
+}
+inline constexpr std::string_view backend_name = "pool";
+#else
+inline par_executor default_executor() {
+  return {};
+}
+inline constexpr std::string_view backend_name = "tbb";
+#endif
+
+// Runs f(tile) for each of num_tiles tiles on exec.
+void for_each_tile(executor auto&& exec, std::uint32_t num_tiles, auto f) {
+  exec.bulk(num_tiles, instrument_tiles(num_tiles, f));
+}
+
+// As above, but no tile starts before every tile below it in its queue has
+// started, as decoupled lookback requires.
+void for_each_tile_in_order(executor auto&& exec, std::uint32_t num_tiles, auto body) {
+  auto f = instrument_tiles(num_tiles, body);
+  if constexpr (requires { exec.bulk_in_order(num_tiles, f); }) {
+    exec.bulk_in_order(num_tiles, f);
+  } else {
+    std::atomic<std::uint32_t> tile_counter(0);
+    exec.bulk(num_tiles,
+      [&] (std::uint32_t) {
+        f(tile_counter.fetch_add(1, std::memory_order_relaxed));
+      });
+  }
+}
+
+} // namespace think_parallel
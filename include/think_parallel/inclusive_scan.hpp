@@ -0,0 +1,278 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/scan_tile_state.hpp>
+#include <think_parallel/workspace.hpp>
+#include <think_parallel/executor.hpp>
+#include <think_parallel/tuning.hpp>
+#include <think_parallel/local_scan.hpp>
+
+#include <ranges>
+#include <algorithm>
+#include <numeric>
+#include <execution>
+#include <atomic>
+
+namespace think_parallel {
+
+template <typename T>
+std::size_t inclusive_scan_upsweep_downsweep_scratch_size(std::size_t,
+                                                          std::uint32_t num_tiles) {
+  return scratch_size_for<T>(num_tiles);
+}
+
+template <fp_order Order = fp_order::fastest>
+void inclusive_scan_upsweep_downsweep(executor auto&& exec,
+                                      stdr::range auto&& in,
+                                      stdr::range auto&& out,
+                                      std::uint32_t num_tiles,
+                                      workspace& ws) {
+  using T = stdr::range_value_t<decltype(in)>;
+
+  num_tiles = scan_num_tiles<T, Order>(size(in), num_tiles);
+
+  ws.reset(inclusive_scan_upsweep_downsweep_scratch_size<T>(size(in), num_tiles));
+
+  auto predecessors = ws.allocate<T>(num_tiles);
+
+  for_each_tile(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+      auto sub_in  = range_for_tile(in, tile, num_tiles);
+      auto sub_out = range_for_tile(out, tile, num_tiles);
+      predecessors[tile] = local_inclusive_scan<Order>(sub_in, sub_out);
+    });
+
+  std::inclusive_scan(begin(predecessors), end(predecessors), begin(predecessors));
+
+  for_each_tile(exec, num_tiles - 1,
+    [&] (std::uint32_t tile) {
+      ++tile;
+      auto sub_out = range_for_tile(out, tile, num_tiles);
+      stdr::for_each(sub_out, [&] (auto& e) { e = predecessors[tile - 1] + e; });
+    });
+}
+
+template <fp_order Order = fp_order::fastest>
+void inclusive_scan_upsweep_downsweep(stdr::range auto&& in,
+                                      stdr::range auto&& out,
+                                      std::uint32_t num_tiles,
+                                      workspace& ws) {
+  inclusive_scan_upsweep_downsweep<Order>(
+    default_executor(), in, out, num_tiles, ws);
+}
+
+template <fp_order Order = fp_order::fastest>
+void inclusive_scan_upsweep_downsweep(stdr::range auto&& in,
+                                      stdr::range auto&& out,
+                                      std::uint32_t num_tiles) {
+  workspace ws;
+  inclusive_scan_upsweep_downsweep<Order>(in, out, num_tiles, ws);
+}
+
+template <typename T,
+          descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial>
+std::size_t inclusive_scan_decoupled_lookback_scratch_size(std::size_t,
+                                                           std::uint32_t num_tiles) {
+  return scan_tile_state<T, Layout, Lookback>::scratch_size(num_tiles);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void inclusive_scan_decoupled_lookback(executor auto&& exec,
+                                       stdr::range auto&& in,
+                                       stdr::range auto&& out,
+                                       std::uint32_t num_tiles,
+                                       workspace& ws) {
+  using T = stdr::range_value_t<decltype(in)>;
+
+  num_tiles = scan_num_tiles<T, Order>(size(in), num_tiles);
+
+  ws.reset(inclusive_scan_decoupled_lookback_scratch_size<T, Layout, Lookback>(
+    size(in), num_tiles));
+
+  scan_tile_state<T, Layout, Lookback> sts(ws, num_tiles);
+
+  for_each_tile_in_order(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+
+      auto sub_in  = range_for_tile(in, tile, num_tiles);
+      auto sub_out = range_for_tile(out, tile, num_tiles);
+
+      // If the predecessor is already complete, seed the local scan with
+      // its prefix so the tile is written exactly once.
+      if constexpr (!is_order_sensitive_v<T, Order>) {
+        if (tile != 0) {
+          if (auto pred = sts.try_predecessor_prefix(tile)) {
+            sts.set_inclusive_prefix(tile,
+              local_inclusive_scan<Order>(sub_in, sub_out, *pred));
+            return;
+          }
+        }
+      }
+
+      sts.set_local_prefix(tile, local_inclusive_scan<Order>(sub_in, sub_out));
+
+      if (tile != 0) {
+        T pred;
+        if constexpr (is_order_sensitive_v<T, Order>)
+          pred = sts.wait_for_complete_predecessor_prefix(tile);
+        else
+          pred = sts.wait_for_predecessor_prefix(tile);
+        stdr::for_each(sub_out, [&] (auto& e) { e = pred + e; });
+      }
+    });
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void inclusive_scan_decoupled_lookback(stdr::range auto&& in,
+                                       stdr::range auto&& out,
+                                       std::uint32_t num_tiles,
+                                       workspace& ws) {
+  inclusive_scan_decoupled_lookback<Layout, Lookback, Order>(
+    default_executor(), in, out, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void inclusive_scan_decoupled_lookback(stdr::range auto&& in,
+                                       stdr::range auto&& out,
+                                       std::uint32_t num_tiles) {
+  workspace ws;
+  inclusive_scan_decoupled_lookback<Layout, Lookback, Order>(in, out, num_tiles, ws);
+}
+
+template <typename T,
+          descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial>
+std::size_t inclusive_scan_reduce_then_scan_scratch_size(std::size_t,
+                                                         std::uint32_t num_tiles) {
+  return scan_tile_state<T, Layout, Lookback>::scratch_size(num_tiles);
+}
+
+// Each tile only reduces its input, publishes that aggregate, and then scans
+// once seeded with the resolved prefix: one write per element instead of
+// two. in and out may be the same range.
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void inclusive_scan_reduce_then_scan(executor auto&& exec,
+                                     stdr::range auto&& in,
+                                     stdr::range auto&& out,
+                                     std::uint32_t num_tiles,
+                                     workspace& ws) {
+  using T = stdr::range_value_t<decltype(in)>;
+
+  num_tiles = scan_num_tiles<T, Order>(size(in), num_tiles);
+
+  ws.reset(inclusive_scan_reduce_then_scan_scratch_size<T, Layout, Lookback>(
+    size(in), num_tiles));
+
+  scan_tile_state<T, Layout, Lookback> sts(ws, num_tiles);
+
+  for_each_tile_in_order(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+
+      auto sub_in  = range_for_tile(in, tile, num_tiles);
+      auto sub_out = range_for_tile(out, tile, num_tiles);
+
+      if (tile == 0) {
+        sts.set_local_prefix(tile, local_inclusive_scan<Order>(sub_in, sub_out));
+        return;
+      }
+
+      // A complete predecessor makes the reduction unnecessary.
+      if constexpr (!is_order_sensitive_v<T, Order>) {
+        if (auto pred = sts.try_predecessor_prefix(tile)) {
+          sts.set_inclusive_prefix(tile,
+            local_inclusive_scan<Order>(sub_in, sub_out, *pred));
+          return;
+        }
+      }
+
+      sts.set_local_prefix(tile, local_reduce<Order>(sub_in));
+
+      T pred;
+      if constexpr (is_order_sensitive_v<T, Order>) {
+        pred = sts.wait_for_complete_predecessor_prefix(tile);
+        local_inclusive_scan_then_add(sub_in, sub_out, pred);
+      } else {
+        pred = sts.wait_for_predecessor_prefix(tile);
+        local_inclusive_scan<Order>(sub_in, sub_out, pred);
+      }
+    });
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void inclusive_scan_reduce_then_scan(stdr::range auto&& in,
+                                     stdr::range auto&& out,
+                                     std::uint32_t num_tiles,
+                                     workspace& ws) {
+  inclusive_scan_reduce_then_scan<Layout, Lookback, Order>(
+    default_executor(), in, out, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void inclusive_scan_reduce_then_scan(stdr::range auto&& in,
+                                     stdr::range auto&& out,
+                                     std::uint32_t num_tiles) {
+  workspace ws;
+  inclusive_scan_reduce_then_scan<Layout, Lookback, Order>(in, out, num_tiles, ws);
+}
+
+// Picks the tile count and the algorithm from the input size and the active
+// tuning: a serial scan for small inputs, upsweep/downsweep for medium ones
+// and decoupled lookback for large ones.
+template <fp_order Order = fp_order::fastest>
+void inclusive_scan_auto(executor auto&& exec,
+                         stdr::range auto&& in,
+                         stdr::range auto&& out,
+                         workspace& ws) {
+  using T = stdr::range_value_t<decltype(in)>;
+
+  auto const& t = active_tuning();
+  auto num_tiles = scan_num_tiles<T, Order>(
+    size(in), auto_num_tiles(size(in), sizeof(T), t));
+
+  switch (t.scan.tier_for(size(in) * sizeof(T))) {
+    case algorithm_tier::serial:
+      // A reproducible scan over more than one tile has to sum tile by tile.
+      if (is_order_sensitive_v<T, Order> && num_tiles != 1) {
+        inclusive_scan_upsweep_downsweep<Order>(exec, in, out, num_tiles, ws);
+        break;
+      }
+      local_inclusive_scan<Order>(in, out);
+      break;
+    case algorithm_tier::multi_pass:
+      inclusive_scan_upsweep_downsweep<Order>(exec, in, out, num_tiles, ws);
+      break;
+    default:
+      inclusive_scan_decoupled_lookback<descriptor_layout::compact,
+                                        lookback_strategy::serial, Order>(
+        exec, in, out, num_tiles, ws);
+  }
+}
+
+template <fp_order Order = fp_order::fastest>
+void inclusive_scan_auto(stdr::range auto&& in,
+                         stdr::range auto&& out,
+                         workspace& ws) {
+  inclusive_scan_auto<Order>(default_executor(), in, out, ws);
+}
+
+template <fp_order Order = fp_order::fastest>
+void inclusive_scan_auto(stdr::range auto&& in,
+                         stdr::range auto&& out) {
+  workspace ws;
+  inclusive_scan_auto<Order>(in, out, ws);
+}
+
+} // namespace think_parallel
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <algorithm>
+#include <utility>
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Per-tile instrumentation, opt in with -DTHINK_PARALLEL_INSTRUMENT=1. When it
+// is off the hooks below are empty and the tile loops run f unwrapped.
+#ifndef THINK_PARALLEL_INSTRUMENT
+  #define THINK_PARALLEL_INSTRUMENT 0
+#endif
+
+namespace think_parallel {
+
+// What one tile did. Times are in nanoseconds; start and finish are relative
+// to the first trace_clock() call of the process.
+struct tile_record {
+  std::uint32_t tile = 0;
+  std::uint32_t thread = 0;
+  std::uint64_t start = 0;
+  std::uint64_t finish = 0;
+  // From the start of the tile until it first published a prefix.
+  std::uint64_t local_time = 0;
+  // Spent spinning or parked on unavailable predecessors.
+  std::uint64_t wait_time = 0;
+  // Predecessor descriptors whose prefix the lookback consumed.
+  std::uint32_t lookback_depth = 0;
+  // Times the tile parked on a predecessor's flag (a futex wait on Linux).
+  std::uint32_t futex_waits = 0;
+};
+
+#if THINK_PARALLEL_INSTRUMENT
+
+inline std::uint64_t trace_clock() {
+  using clock = std::chrono::steady_clock;
+  static auto const epoch = clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    clock::now() - epoch).count();
+}
+
+inline std::uint32_t trace_thread_id() {
+  static std::atomic<std::uint32_t> next_id = 0;
+  thread_local std::uint32_t const id = next_id.fetch_add(1);
+  return id;
+}
+
+inline thread_local tile_record* current_tile_record = nullptr;
+
+// The recorded tile loops, grouped into runs. Loops outside a run are not
+// recorded. Each run is labeled, e.g. with the benchmark name, and starting
+// a run discards the previous recording under the same label, so the last
+// run of each label is kept.
+struct tile_trace {
+  struct loop {
+    std::string label;
+    std::vector<tile_record> tiles;
+  };
+
+  std::mutex mutex;
+  std::string label;
+  std::vector<loop> loops;
+
+  void begin_run(std::string_view run_label) {
+    std::lock_guard lock(mutex);
+    label = run_label;
+    std::erase_if(loops, [&] (loop const& l) { return l.label == label; });
+  }
+
+  void end_run() {
+    std::lock_guard lock(mutex);
+    label.clear();
+  }
+
+  std::span<tile_record> begin_loop(std::uint32_t num_tiles) {
+    std::lock_guard lock(mutex);
+    if (label.empty())
+      return {};
+    loops.push_back({label, std::vector<tile_record>(num_tiles)});
+    return loops.back().tiles;
+  }
+
+  // Writes the Chrome trace event format, which chrome://tracing and
+  // Perfetto load: one process per label, one thread per worker, and one
+  // event per tile with its local phase nested inside.
+  void write_chrome_trace(std::ostream& os) {
+    std::lock_guard lock(mutex);
+    std::vector<std::string> labels;
+    os << "{\"traceEvents\": [";
+    bool first = true;
+    auto event = [&] { os << (first ? "\n" : ",\n"); first = false; };
+    for (auto const& l : loops) {
+      auto it = std::find(labels.begin(), labels.end(), l.label);
+      auto pid = std::size_t(it - labels.begin());
+      if (it == labels.end()) {
+        labels.push_back(l.label);
+        event();
+        os << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid
+           << ", \"args\": {\"name\": \"";
+        for (char c : l.label)
+          os << (c == '"' || c == '\\' ? "\\" : "") << c;
+        os << "\"}}";
+      }
+      for (auto const& r : l.tiles) {
+        if (r.finish == 0)
+          continue;
+        event();
+        os << "{\"name\": \"tile " << r.tile << "\", \"ph\": \"X\""
+           << ", \"pid\": " << pid << ", \"tid\": " << r.thread
+           << ", \"ts\": " << r.start / 1e3
+           << ", \"dur\": " << (r.finish - r.start) / 1e3
+           << ", \"args\": {\"tile\": " << r.tile
+           << ", \"local_us\": " << r.local_time / 1e3
+           << ", \"wait_us\": " << r.wait_time / 1e3
+           << ", \"lookback_depth\": " << r.lookback_depth
+           << ", \"futex_waits\": " << r.futex_waits << "}}";
+        event();
+        os << "{\"name\": \"local\", \"ph\": \"X\""
+           << ", \"pid\": " << pid << ", \"tid\": " << r.thread
+           << ", \"ts\": " << r.start / 1e3
+           << ", \"dur\": " << r.local_time / 1e3 << "}";
+      }
+    }
+    os << "\n]}\n";
+  }
+};
+
+inline tile_trace& active_tile_trace() {
+  static tile_trace trace;
+  return trace;
+}
+
+// Wraps a tile loop body so that each call records into its own slot.
+inline auto instrument_tiles(std::uint32_t num_tiles, auto f) {
+  return [records = active_tile_trace().begin_loop(num_tiles), f]
+         (std::uint32_t tile) {
+    if (records.empty())
+      return f(tile);
+    auto& r = records[tile];
+    r.tile   = tile;
+    r.thread = trace_thread_id();
+    r.start  = trace_clock();
+    auto outer = std::exchange(current_tile_record, &r);
+    f(tile);
+    current_tile_record = outer;
+    r.finish = trace_clock();
+    if (r.local_time == 0)
+      r.local_time = r.finish - r.start;
+  };
+}
+
+inline void instrument_publish() {
+  if (auto r = current_tile_record; r && r->local_time == 0)
+    r->local_time = trace_clock() - r->start;
+}
+
+inline void instrument_lookback(std::uint32_t depth) {
+  if (auto r = current_tile_record)
+    r->lookback_depth += depth;
+}
+
+inline void instrument_wait(std::uint64_t since, bool parked) {
+  if (auto r = current_tile_record) {
+    r->wait_time += trace_clock() - since;
+    r->futex_waits += parked;
+  }
+}
+
+#else
+
+inline std::uint64_t trace_clock() { return 0; }
+
+inline auto instrument_tiles(std::uint32_t, auto f) { return f; }
+
+inline void instrument_publish() {}
+
+inline void instrument_lookback(std::uint32_t) {}
+
+inline void instrument_wait(std::uint64_t, bool) {}
+
+#endif
+
+} // namespace think_parallel
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/simd.hpp>
+
+#include <ranges>
+#include <numeric>
+#include <execution>
+#include <iterator>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <bit>
+#include <functional>
+#include <algorithm>
+
+namespace think_parallel {
+
+// fastest:      combine floating point values in whatever order is quickest
+//               (vector log-step scans, arbitrary lookback depth).
+// reproducible: combine them in a fixed order so results are bitwise
+//               identical across runs, tile counts, tile schedules and
+//               instruction sets. The input is split into tiles by its size
+//               alone (see scan_num_tiles); each tile is summed left to right
+//               from its first element, the tile sums are folded left to
+//               right, and each output is the fold of the preceding tiles
+//               plus the tile's own partial sum.
+// Integral types ignore the distinction.
+enum class fp_order {
+  fastest,
+  reproducible
+};
+
+template <typename T>
+inline constexpr bool is_simd_scannable_v =
+     std::same_as<T, std::int32_t> || std::same_as<T, std::uint32_t>
+  || std::same_as<T, std::int64_t> || std::same_as<T, std::uint64_t>
+  || std::same_as<T, float>        || std::same_as<T, double>;
+
+template <typename T, fp_order Order>
+inline constexpr bool is_order_sensitive_v =
+  std::floating_point<T> && Order == fp_order::reproducible;
+
+// A reproducible scan ignores the tile count it is given and uses tiles of
+// about this many elements, so that the order values are combined in
+// depends only on the input size.
+inline constexpr std::size_t reproducible_tile_size = 16 * 1024;
+
+// The tile count a scan over n values of T really runs with.
+template <typename T, fp_order Order>
+std::uint32_t scan_num_tiles(std::size_t n, std::uint32_t num_tiles) {
+  if constexpr (is_order_sensitive_v<T, Order>)
+    return std::uint32_t(std::max<std::size_t>(
+      (n + reproducible_tile_size - 1) / reproducible_tile_size, 1));
+  else
+    return num_tiles;
+}
+
+template <typename T>
+T inclusive_scan_scalar(T const* in, std::size_t n, T* out, T carry) {
+  for (std::size_t i = 0; i < n; ++i)
+    out[i] = carry = carry + in[i];
+  return carry;
+}
+
+#if THINK_PARALLEL_X86_SIMD
+
+// Each kernel scans one register with log2(lanes) shift-and-add steps, adds
+// the running carry and broadcasts the last lane as the next carry.
+
+THINK_PARALLEL_TARGET_AVX2 inline
+__m256i prefix_sum_epi32_avx2(__m256i x) {
+  x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+  x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+  auto low = _mm256_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+  return _mm256_add_epi32(x, _mm256_permute2x128_si256(low, low, 0x08));
+}
+
+THINK_PARALLEL_TARGET_AVX2 inline
+__m256i prefix_sum_epi64_avx2(__m256i x) {
+  x = _mm256_add_epi64(x, _mm256_slli_si256(x, 8));
+  auto low = _mm256_shuffle_epi32(x, _MM_SHUFFLE(3, 2, 3, 2));
+  return _mm256_add_epi64(x, _mm256_permute2x128_si256(low, low, 0x08));
+}
+
+THINK_PARALLEL_TARGET_AVX2 inline
+__m256 prefix_sum_ps_avx2(__m256 x) {
+  auto bits = _mm256_castps_si256(x);
+  x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(bits, 4)));
+  bits = _mm256_castps_si256(x);
+  x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(bits, 8)));
+  auto low = _mm256_permute_ps(x, _MM_SHUFFLE(3, 3, 3, 3));
+  return _mm256_add_ps(x, _mm256_permute2f128_ps(low, low, 0x08));
+}
+
+THINK_PARALLEL_TARGET_AVX2 inline
+__m256d prefix_sum_pd_avx2(__m256d x) {
+  x = _mm256_add_pd(x, _mm256_castsi256_pd(
+                         _mm256_slli_si256(_mm256_castpd_si256(x), 8)));
+  auto low = _mm256_permute_pd(x, 0b1111);
+  return _mm256_add_pd(x, _mm256_permute2f128_pd(low, low, 0x08));
+}
+
+template <typename T>
+THINK_PARALLEL_TARGET_AVX2
+T inclusive_scan_avx2(T const* in, std::size_t n, T* out, T carry) {
+  std::size_t i = 0;
+  if constexpr (sizeof(T) == 4 && std::integral<T>) {
+    auto c = _mm256_set1_epi32(std::int32_t(carry));
+    for (; i + 8 <= n; i += 8) {
+      auto x = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(in + i));
+      x = _mm256_add_epi32(prefix_sum_epi32_avx2(x), c);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), x);
+      c = _mm256_permutevar8x32_epi32(x, _mm256_set1_epi32(7));
+    }
+  } else if constexpr (sizeof(T) == 8 && std::integral<T>) {
+    auto c = _mm256_set1_epi64x(std::int64_t(carry));
+    for (; i + 4 <= n; i += 4) {
+      auto x = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(in + i));
+      x = _mm256_add_epi64(prefix_sum_epi64_avx2(x), c);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), x);
+      c = _mm256_permute4x64_epi64(x, 0xFF);
+    }
+  } else if constexpr (std::same_as<T, float>) {
+    auto c = _mm256_set1_ps(carry);
+    for (; i + 8 <= n; i += 8) {
+      auto x = _mm256_add_ps(prefix_sum_ps_avx2(_mm256_loadu_ps(in + i)), c);
+      _mm256_storeu_ps(out + i, x);
+      c = _mm256_permutevar8x32_ps(x, _mm256_set1_epi32(7));
+    }
+  } else {
+    auto c = _mm256_set1_pd(carry);
+    for (; i + 4 <= n; i += 4) {
+      auto x = _mm256_add_pd(prefix_sum_pd_avx2(_mm256_loadu_pd(in + i)), c);
+      _mm256_storeu_pd(out + i, x);
+      c = _mm256_permute4x64_pd(x, 0xFF);
+    }
+  }
+  if (i != 0)
+    carry = out[i - 1];
+  return inclusive_scan_scalar(in + i, n - i, out + i, carry);
+}
+
+template <typename T>
+THINK_PARALLEL_TARGET_AVX512 inline
+__m512i add_lanes_avx512(__m512i a, __m512i b) {
+  if constexpr (std::integral<T> && sizeof(T) == 4)
+    return _mm512_add_epi32(a, b);
+  else if constexpr (std::integral<T>)
+    return _mm512_add_epi64(a, b);
+  else if constexpr (sizeof(T) == 4)
+    return _mm512_castps_si512(
+      _mm512_add_ps(_mm512_castsi512_ps(a), _mm512_castsi512_ps(b)));
+  else
+    return _mm512_castpd_si512(
+      _mm512_add_pd(_mm512_castsi512_pd(a), _mm512_castsi512_pd(b)));
+}
+
+// alignr against zero shifts the register up by (lanes - imm) lanes.
+template <typename T>
+THINK_PARALLEL_TARGET_AVX512 inline
+__m512i prefix_sum_avx512(__m512i x) {
+  auto const zero = _mm512_setzero_si512();
+  if constexpr (sizeof(T) == 4) {
+    x = add_lanes_avx512<T>(x, _mm512_maskz_alignr_epi32(0xFFFF, x, zero, 15));
+    x = add_lanes_avx512<T>(x, _mm512_maskz_alignr_epi32(0xFFFF, x, zero, 14));
+    x = add_lanes_avx512<T>(x, _mm512_maskz_alignr_epi32(0xFFFF, x, zero, 12));
+    x = add_lanes_avx512<T>(x, _mm512_maskz_alignr_epi32(0xFFFF, x, zero, 8));
+  } else {
+    x = add_lanes_avx512<T>(x, _mm512_maskz_alignr_epi64(0xFF, x, zero, 7));
+    x = add_lanes_avx512<T>(x, _mm512_maskz_alignr_epi64(0xFF, x, zero, 6));
+    x = add_lanes_avx512<T>(x, _mm512_maskz_alignr_epi64(0xFF, x, zero, 4));
+  }
+  return x;
+}
+
+template <typename T>
+THINK_PARALLEL_TARGET_AVX512
+T inclusive_scan_avx512(T const* in, std::size_t n, T* out, T carry) {
+  constexpr std::size_t lanes = 64 / sizeof(T);
+
+  __m512i c, last;
+  if constexpr (sizeof(T) == 4) {
+    c    = _mm512_set1_epi32(std::bit_cast<std::int32_t>(carry));
+    last = _mm512_set1_epi32(15);
+  } else {
+    c    = _mm512_set1_epi64(std::bit_cast<std::int64_t>(carry));
+    last = _mm512_set1_epi64(7);
+  }
+
+  std::size_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    auto x = add_lanes_avx512<T>(prefix_sum_avx512<T>(_mm512_loadu_si512(in + i)), c);
+    _mm512_storeu_si512(out + i, x);
+    if constexpr (sizeof(T) == 4)
+      c = _mm512_maskz_permutexvar_epi32(0xFFFF, last, x);
+    else
+      c = _mm512_maskz_permutexvar_epi64(0xFF, last, x);
+  }
+
+  if (i != 0)
+    carry = out[i - 1];
+
+  return inclusive_scan_scalar(in + i, n - i, out + i, carry);
+}
+
+#endif
+
+// out[i] = carry + in[0] + ... + in[i]; returns the last output, or carry if
+// the input is empty. in and out may alias exactly.
+template <fp_order Order = fp_order::fastest, typename T>
+T inclusive_scan_simd(T const* in, std::size_t n, T* out, T carry) {
+#if THINK_PARALLEL_X86_SIMD
+  if constexpr (!is_order_sensitive_v<T, Order>) {
+    switch (active_simd_isa()) {
+      case simd_isa::avx512: return inclusive_scan_avx512(in, n, out, carry);
+      case simd_isa::avx2:   return inclusive_scan_avx2(in, n, out, carry);
+      default:               break;
+    }
+  }
+#endif
+  return inclusive_scan_scalar(in, n, out, carry);
+}
+
+// Scans one tile, seeded with carry, through the vector kernels when the
+// ranges are contiguous and the value type is supported. Returns the last
+// output, or carry for an empty tile.
+template <fp_order Order = fp_order::fastest>
+auto local_inclusive_scan(stdr::range auto&& in,
+                          stdr::range auto&& out,
+                          auto carry) {
+  using T = decltype(carry);
+  if constexpr (is_simd_scannable_v<T>
+             && stdr::contiguous_range<decltype(in)>
+             && stdr::contiguous_range<decltype(out)>
+             && std::same_as<stdr::range_value_t<decltype(in)>, T>
+             && std::same_as<stdr::range_value_t<decltype(out)>, T>) {
+    return inclusive_scan_simd<Order>(stdr::data(in), size(in),
+                                      stdr::data(out), carry);
+  } else {
+    if (begin(in) == end(in))
+      return carry;
+    return *--std::inclusive_scan(begin(in), end(in), begin(out),
+                                  std::plus<>{}, carry);
+  }
+}
+
+// Reduces one tile. Vectorized unless the order is significant.
+template <fp_order Order = fp_order::fastest>
+auto local_reduce(stdr::range auto&& in) {
+  using T = stdr::range_value_t<decltype(in)>;
+  if constexpr (is_order_sensitive_v<T, Order>)
+    return std::accumulate(begin(in), end(in), T{});
+  else
+    return std::reduce(stde::unseq, begin(in), end(in), T{});
+}
+
+// Scans one tile from its first element and adds carry to each output, the
+// order reproducible scans use for every tile after the first. Returns the
+// tile's own aggregate.
+template <typename T>
+T local_inclusive_scan_then_add(stdr::range auto&& in,
+                                stdr::range auto&& out,
+                                T carry) {
+  T sum{};
+  auto o = begin(out);
+  for (auto&& e : in)
+    *o++ = carry + (sum = sum + e);
+  return sum;
+}
+
+// As above, without a carry-in.
+template <fp_order Order = fp_order::fastest>
+auto local_inclusive_scan(stdr::range auto&& in,
+                          stdr::range auto&& out) {
+  using T = stdr::range_value_t<decltype(in)>;
+  if constexpr (is_simd_scannable_v<T>) {
+    return local_inclusive_scan<Order>(in, out, T{});
+  } else {
+    if (begin(in) == end(in))
+      return T{};
+    return T(*--std::inclusive_scan(begin(in), end(in), begin(out)));
+  }
+}
+
+} // namespace think_parallel
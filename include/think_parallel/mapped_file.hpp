@@ -0,0 +1,106 @@
+#pragma once
+
+#include <span>
+#include <cstddef>
+#include <cerrno>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace think_parallel {
+
+// A file mapped into memory, so the algorithms can run directly over on-disk
+// data. mmap returns page-aligned memory, and range_for_tile aligns large
+// tiles to tile_alignment elements, so each tile faults in its own pages.
+struct mapped_file {
+  int fd = -1;
+  std::byte* data = nullptr;
+  std::size_t bytes = 0;
+
+  // The file constructors delegate here, so that a failure part way through
+  // them still runs the destructor.
+  mapped_file() = default;
+
+  // Maps an existing file read-only, hinting sequential access and
+  // read-ahead of the whole file.
+  explicit mapped_file(std::string const& path) : mapped_file() {
+    fd = check(::open(path.c_str(), O_RDONLY), "open");
+    struct stat st;
+    check(::fstat(fd, &st), "fstat");
+    map(std::size_t(st.st_size), PROT_READ);
+    advise(MADV_SEQUENTIAL);
+    advise(MADV_WILLNEED);
+  }
+
+  // Creates or truncates a file of the given size and maps it read-write;
+  // stores through the mapping end up in the file.
+  mapped_file(std::string const& path, std::size_t size) : mapped_file() {
+    fd = check(::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644), "open");
+    check(::ftruncate(fd, off_t(size)), "ftruncate");
+    map(size, PROT_READ | PROT_WRITE);
+    advise(MADV_SEQUENTIAL);
+  }
+
+  mapped_file(mapped_file&& other) noexcept
+    : fd(std::exchange(other.fd, -1)),
+      data(std::exchange(other.data, nullptr)),
+      bytes(std::exchange(other.bytes, 0)) {}
+
+  mapped_file& operator=(mapped_file&& other) noexcept {
+    std::swap(fd, other.fd);
+    std::swap(data, other.data);
+    std::swap(bytes, other.bytes);
+    return *this;
+  }
+
+  ~mapped_file() {
+    if (data)
+      ::munmap(data, bytes);
+    if (fd != -1)
+      ::close(fd);
+  }
+
+  template <typename T>
+  std::span<T> as() const {
+    return {reinterpret_cast<T*>(data), bytes / sizeof(T)};
+  }
+
+  // Hints are best effort; kernels without transparent huge pages for file
+  // mappings simply reject MADV_HUGEPAGE.
+  void advise(int advice) {
+    if (data)
+      ::madvise(data, bytes, advice);
+  }
+
+  // Writes dirty pages back to the file.
+  void sync() {
+    if (data)
+      check(::msync(data, bytes, MS_SYNC), "msync");
+  }
+
+  static int check(int result, char const* what) {
+    if (result == -1)
+      throw std::system_error(errno, std::generic_category(), what);
+    return result;
+  }
+
+  void map(std::size_t size, int protection) {
+    bytes = size;
+    if (bytes == 0)
+      return;
+    auto p = ::mmap(nullptr, bytes, protection, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+      throw std::system_error(errno, std::generic_category(), "mmap");
+    data = static_cast<std::byte*>(p);
+#ifdef MADV_HUGEPAGE
+    advise(MADV_HUGEPAGE);
+#endif
+  }
+};
+
+} // namespace think_parallel
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/executor.hpp>
+
+#include <ranges>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace think_parallel {
+
+// Parses a Linux CPU list such as "0-3,8,10-11".
+inline std::vector<unsigned> parse_cpu_list(std::string const& list) {
+  std::vector<unsigned> cpus;
+  for (auto&& part : list | stdv::split(',')) {
+    std::string range(begin(part), end(part));
+    if (range.empty() || range == "\n")
+      continue;
+    auto dash = range.find('-');
+    unsigned first = std::stoul(range.substr(0, dash));
+    unsigned last  = dash == std::string::npos ? first
+                                               : std::stoul(range.substr(dash + 1));
+    for (auto c = first; c <= last; ++c)
+      cpus.push_back(c);
+  }
+  return cpus;
+}
+
+// The CPUs this process may run on, grouped by NUMA node. Setting
+// THINK_PARALLEL_NUMA_NODES to k instead splits them into k simulated nodes,
+// so the NUMA paths can be exercised on a single-node machine; with fewer
+// CPUs than nodes, the simulated nodes share CPUs.
+inline std::vector<std::vector<unsigned>> detect_numa_nodes() {
+  auto cpus = thread_pool::allowed_cpus();
+  if (cpus.empty())
+    cpus.push_back(0);
+
+  auto env = std::getenv("THINK_PARALLEL_NUMA_NODES");
+  if (std::size_t k = env ? std::strtoul(env, nullptr, 10) : 0; k > 0) {
+    std::vector<std::vector<unsigned>> nodes(k);
+    for (std::size_t node = 0; node < k; ++node) {
+      auto b = cpus.size() * node / k;
+      auto e = cpus.size() * (node + 1) / k;
+      if (b == e)
+        nodes[node].push_back(cpus[node % cpus.size()]);
+      else
+        nodes[node].assign(begin(cpus) + b, begin(cpus) + e);
+    }
+    return nodes;
+  }
+
+  std::vector<std::vector<unsigned>> nodes;
+#if defined(__linux__)
+  for (unsigned node = 0; ; ++node) {
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node)
+                       + "/cpulist");
+    if (!file)
+      break;
+    std::string list;
+    std::getline(file, list);
+    std::vector<unsigned> allowed;
+    for (auto c : parse_cpu_list(list))
+      if (stdr::find(cpus, c) != end(cpus))
+        allowed.push_back(c);
+    if (!allowed.empty())
+      nodes.push_back(std::move(allowed));
+  }
+#endif
+  if (nodes.empty())
+    nodes.push_back(cpus);
+  return nodes;
+}
+
+inline std::vector<std::vector<unsigned>> const& numa_nodes() {
+  static auto const nodes = detect_numa_nodes();
+  return nodes;
+}
+
+// A process-wide pool with one worker pinned to each CPU, grouped by node.
+// The tiles are dealt out to the nodes round-robin, a chunk of one tile per
+// CPU at a time, so every node scans near the front of the input at once.
+// A tile's lookback reads another node's descriptors only where it crosses
+// back into the previous chunk, typically for the first tiles of a chunk.
+inline thread_pool& default_numa_thread_pool() {
+  static thread_pool pool(numa_nodes());
+  return pool;
+}
+
+inline pool_executor numa_executor() {
+  return {&default_numa_thread_pool()};
+}
+
+// Value-initializes r tile by tile on exec. Memory that has never been
+// touched, such as a large make_unique_for_overwrite allocation, is placed
+// on the node of the thread that first writes it. With the numa_executor
+// and the same tile count, most of each tile's pages end up on the node
+// whose queue holds the tile, but placement is best effort: the calling
+// thread is not pinned and drains node 0's queue, and idle workers run
+// tiles from other nodes' queues, so some pages land elsewhere.
+void first_touch(executor auto&& exec,
+                 stdr::range auto&& r,
+                 std::uint32_t num_tiles) {
+  for_each_tile(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+      stdr::fill(range_for_tile(r, tile, num_tiles),
+                 stdr::range_value_t<decltype(r)>{});
+    });
+}
+
+} // namespace think_parallel
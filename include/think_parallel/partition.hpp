@@ -0,0 +1,199 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/scan_tile_state.hpp>
+#include <think_parallel/workspace.hpp>
+#include <think_parallel/executor.hpp>
+
+#include <ranges>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <utility>
+#include <iterator>
+#include <cstdint>
+
+namespace think_parallel {
+
+template <typename Index = std::uint32_t>
+std::size_t partition_copy_decoupled_lookback_scratch_size(std::size_t,
+                                                           std::uint32_t num_tiles) {
+  return scan_tile_state<Index>::scratch_size(num_tiles);
+}
+
+// A stable partition_copy in one pass over the input: the elements for which
+// op is true go to out_true and the others to out_false, both in input order.
+// Only the true count is scanned; a tile's false side starts at the tile's
+// offset in the input minus its true side's start. op is evaluated once per
+// element, into a per-tile bitmask.
+template <typename Index = std::uint32_t>
+auto partition_copy_decoupled_lookback(executor auto&& exec,
+                                       stdr::range auto&& in,
+                                       auto out_true,
+                                       auto out_false,
+                                       auto op,
+                                       std::uint32_t num_tiles,
+                                       workspace& ws) {
+  ws.reset(partition_copy_decoupled_lookback_scratch_size<Index>(size(in), num_tiles));
+
+  scan_tile_state<Index> sts(ws, num_tiles);
+
+  for_each_tile_in_order(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+
+      auto sub_in = range_for_tile(in, tile, num_tiles);
+      auto first  = begin(sub_in);
+      auto n      = size(sub_in);
+
+      auto& tile_ws = tile_workspace();
+      tile_ws.reset(scratch_size_for<std::uint64_t>((n + 63) / 64));
+      auto mask = tile_ws.allocate<std::uint64_t>((n + 63) / 64);
+
+      Index count = 0;
+      for (std::size_t w = 0; w < size(mask); ++w) {
+        std::uint64_t bits = 0;
+        auto last = std::min<std::size_t>(64, n - w * 64);
+        for (std::size_t b = 0; b < last; ++b)
+          bits |= std::uint64_t(bool(op(first[w * 64 + b]))) << b;
+        mask[w] = bits;
+        count += std::popcount(bits);
+      }
+
+      sts.set_local_prefix(tile, count);
+
+      Index true_index  = tile != 0 ? sts.wait_for_predecessor_prefix(tile) : 0;
+      Index false_index = Index(distance(begin(in), first)) - true_index;
+
+      for (std::size_t w = 0; w < size(mask); ++w) {
+        auto last = std::min<std::size_t>(64, n - w * 64);
+        for (std::size_t b = 0; b < last; ++b) {
+          if ((mask[w] >> b) & 1)
+            out_true[true_index++] = first[w * 64 + b];
+          else
+            out_false[false_index++] = first[w * 64 + b];
+        }
+      }
+    });
+
+  auto num_true = sts.inclusive_prefix(num_tiles - 1);
+  return std::pair(stdr::subrange(out_true, next(out_true, num_true)),
+                   stdr::subrange(out_false,
+                                  next(out_false, Index(size(in)) - num_true)));
+}
+
+template <typename Index = std::uint32_t>
+auto partition_copy_decoupled_lookback(stdr::range auto&& in,
+                                       auto out_true,
+                                       auto out_false,
+                                       auto op,
+                                       std::uint32_t num_tiles,
+                                       workspace& ws) {
+  return partition_copy_decoupled_lookback<Index>(
+    default_executor(), in, out_true, out_false, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+auto partition_copy_decoupled_lookback(stdr::range auto&& in,
+                                       auto out_true,
+                                       auto out_false,
+                                       auto op,
+                                       std::uint32_t num_tiles) {
+  workspace ws;
+  return partition_copy_decoupled_lookback<Index>(
+    in, out_true, out_false, op, num_tiles, ws);
+}
+
+// Adds per-bucket counts bucket by bucket.
+struct bucket_plus {
+  template <typename Index, std::size_t K>
+  constexpr std::array<Index, K> operator()(std::array<Index, K> l,
+                                            std::array<Index, K> const& r) const {
+    for (std::size_t b = 0; b < K; ++b)
+      l[b] += r[b];
+    return l;
+  }
+};
+
+template <std::size_t K, typename Index = std::uint32_t>
+using split_tile_state = scan_tile_state<std::array<Index, K>,
+                                         descriptor_layout::compact,
+                                         lookback_strategy::serial,
+                                         bucket_plus>;
+
+template <std::size_t K, typename Index = std::uint32_t>
+std::size_t split_decoupled_lookback_scratch_size(std::size_t,
+                                                  std::uint32_t num_tiles) {
+  return split_tile_state<K, Index>::scratch_size(num_tiles);
+}
+
+// A stable K-way split in one pass over the input: each element e goes to
+// outs[bucket_of(e)], where bucket_of returns a value in [0, K), and each
+// bucket keeps input order. The tiles' per-bucket counts are scanned as one
+// vector. Returns the elements written to each bucket.
+template <typename Index = std::uint32_t, typename Out, std::size_t K>
+auto split_decoupled_lookback(executor auto&& exec,
+                              stdr::range auto&& in,
+                              std::array<Out, K> outs,
+                              auto bucket_of,
+                              std::uint32_t num_tiles,
+                              workspace& ws) {
+  static_assert(K <= 256, "split_decoupled_lookback supports at most 256 buckets");
+
+  ws.reset(split_decoupled_lookback_scratch_size<K, Index>(size(in), num_tiles));
+
+  split_tile_state<K, Index> sts(ws, num_tiles);
+
+  for_each_tile_in_order(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+
+      auto sub_in = range_for_tile(in, tile, num_tiles);
+      auto first  = begin(sub_in);
+      auto n      = size(sub_in);
+
+      auto& tile_ws = tile_workspace();
+      tile_ws.reset(scratch_size_for<std::uint8_t>(n));
+      auto buckets = tile_ws.allocate<std::uint8_t>(n);
+
+      std::array<Index, K> counts{};
+      for (std::size_t i = 0; i < n; ++i) {
+        auto b = std::uint8_t(bucket_of(first[i]));
+        buckets[i] = b;
+        ++counts[b];
+      }
+
+      sts.set_local_prefix(tile, counts);
+
+      auto indices = tile != 0 ? sts.wait_for_predecessor_prefix(tile)
+                               : std::array<Index, K>{};
+
+      for (std::size_t i = 0; i < n; ++i)
+        outs[buckets[i]][indices[buckets[i]]++] = first[i];
+    });
+
+  auto totals = sts.inclusive_prefix(num_tiles - 1);
+  std::array<stdr::subrange<Out>, K> split;
+  for (std::size_t b = 0; b < K; ++b)
+    split[b] = stdr::subrange(outs[b], next(outs[b], totals[b]));
+  return split;
+}
+
+template <typename Index = std::uint32_t, typename Out, std::size_t K>
+auto split_decoupled_lookback(stdr::range auto&& in,
+                              std::array<Out, K> outs,
+                              auto bucket_of,
+                              std::uint32_t num_tiles,
+                              workspace& ws) {
+  return split_decoupled_lookback<Index>(
+    default_executor(), in, outs, bucket_of, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t, typename Out, std::size_t K>
+auto split_decoupled_lookback(stdr::range auto&& in,
+                              std::array<Out, K> outs,
+                              auto bucket_of,
+                              std::uint32_t num_tiles) {
+  workspace ws;
+  return split_decoupled_lookback<Index>(in, outs, bucket_of, num_tiles, ws);
+}
+
+} // namespace think_parallel
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/scan_tile_state.hpp>
+#include <think_parallel/workspace.hpp>
+#include <think_parallel/executor.hpp>
+
+#include <ranges>
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <iterator>
+#include <cstdint>
+
+namespace think_parallel {
+
+// Fused pipelines: a chain of stages that run one after the other inside a
+// single tile pass, so each tile's data stays in cache from the first stage
+// to the last and the input is dispatched once. Each stage writes the
+// tile's elements into tile-local scratch for the next one. Stages that
+// need the prefix of everything before the tile, such as scans, resolve it
+// through their own scan_tile_state, and the output position of each tile
+// is resolved through one more, over the number of elements that came out
+// of the last stage.
+//
+//   tp::pipeline p{tp::transform_stage{f},
+//                  tp::filter_stage{pred},
+//                  tp::scan_stage{std::plus<>{}}};
+//   auto written = tp::run_pipeline(p, in, out, num_tiles);
+//
+// A stage has an output_t<T> for the element type it produces from T, a
+// tile_state_t<T> and an init_tile_state for any cross-tile state it needs,
+// and a call operator that turns the tile's elements into a prefix of the
+// span it is given.
+
+struct no_tile_state {
+  static std::size_t scratch_size(std::uint32_t) {
+    return 0;
+  }
+};
+
+// Applies f to each element.
+template <typename F>
+struct transform_stage {
+  F f;
+
+  template <typename T>
+  using output_t = std::remove_cvref_t<std::invoke_result_t<F const&, T const&>>;
+
+  template <typename T>
+  using tile_state_t = no_tile_state;
+
+  void init_tile_state(auto& state, workspace&, std::uint32_t) const {
+    state.emplace();
+  }
+
+  template <typename U>
+  std::span<U> operator()(auto&& in, std::span<U> out,
+                          no_tile_state&, std::uint32_t) const {
+    auto o = begin(out);
+    for (auto&& e : in)
+      *o++ = f(e);
+    return out.first(size(in));
+  }
+};
+
+// Keeps the elements for which pred is true, in order.
+template <typename Pred>
+struct filter_stage {
+  Pred pred;
+
+  template <typename T>
+  using output_t = T;
+
+  template <typename T>
+  using tile_state_t = no_tile_state;
+
+  void init_tile_state(auto& state, workspace&, std::uint32_t) const {
+    state.emplace();
+  }
+
+  template <typename U>
+  std::span<U> operator()(auto&& in, std::span<U> out,
+                          no_tile_state&, std::uint32_t) const {
+    // Branch free: every element is written and only the kept ones advance.
+    std::size_t count = 0;
+    for (auto&& e : in) {
+      out[count] = e;
+      count += bool(pred(e));
+    }
+    return out.first(count);
+  }
+};
+
+// Lifts op to optional values, with an empty optional as the identity, so a
+// tile that receives no elements can still publish a prefix.
+template <typename Op>
+struct optional_op {
+  [[no_unique_address]] Op op;
+
+  template <typename T>
+  constexpr std::optional<T> operator()(std::optional<T> const& l,
+                                        std::optional<T> const& r) const {
+    if (!l)
+      return r;
+    if (!r)
+      return l;
+    return T(op(*l, *r));
+  }
+};
+
+// An inclusive scan under the associative op over every element that
+// reaches this stage, across all tiles.
+template <typename Op = std::plus<>>
+struct scan_stage {
+  [[no_unique_address]] Op op;
+
+  template <typename T>
+  using output_t = T;
+
+  template <typename T>
+  using tile_state_t = scan_tile_state<std::optional<T>,
+                                       descriptor_layout::compact,
+                                       lookback_strategy::serial,
+                                       optional_op<Op>>;
+
+  void init_tile_state(auto& state, workspace& ws, std::uint32_t num_tiles) const {
+    state.emplace(ws, num_tiles, optional_op<Op>{op});
+  }
+
+  template <typename U>
+  std::span<U> operator()(auto&& in, std::span<U> out,
+                          tile_state_t<U>& sts, std::uint32_t tile) const {
+    auto n = size(in);
+
+    auto scan = [&] (std::optional<U> carry) -> std::optional<U> {
+      auto first = begin(in);
+      auto last  = end(in);
+      if (first == last)
+        return carry;
+      U sum = carry ? U(op(*carry, *first)) : U(*first);
+      auto o = begin(out);
+      *o++ = sum;
+      while (++first != last)
+        *o++ = sum = op(sum, *first);
+      return sum;
+    };
+
+    // If the predecessor is already complete, seed the scan with its prefix
+    // so the tile is written exactly once.
+    if (tile != 0) {
+      if (auto pred = sts.try_predecessor_prefix(tile)) {
+        sts.set_inclusive_prefix(tile, scan(*pred));
+        return out.first(n);
+      }
+    }
+
+    sts.set_local_prefix(tile, scan(std::nullopt));
+
+    if (tile != 0)
+      if (auto pred = sts.wait_for_predecessor_prefix(tile))
+        for (auto& e : out.first(n))
+          e = op(*pred, e);
+
+    return out.first(n);
+  }
+};
+
+template <typename... Stages>
+struct pipeline {
+  std::tuple<Stages...> stages;
+
+  pipeline(Stages... stages) : stages(stages...) {}
+};
+
+template <typename T, typename Tuple>
+struct tuple_prepend;
+
+template <typename T, typename... Ts>
+struct tuple_prepend<T, std::tuple<Ts...>> {
+  using type = std::tuple<T, Ts...>;
+};
+
+// The element types flowing through a pipeline whose input is T, and the
+// scratch its stages need.
+template <typename T, typename... Stages>
+struct pipeline_traits {
+  using value_type  = T;
+  using tile_states = std::tuple<>;
+
+  static std::size_t scratch_size(std::uint32_t) {
+    return 0;
+  }
+
+  static std::size_t tile_scratch_size(std::size_t) {
+    return 0;
+  }
+};
+
+template <typename T, typename Stage, typename... Rest>
+struct pipeline_traits<T, Stage, Rest...> {
+  using output      = typename Stage::template output_t<T>;
+  using tile_state  = typename Stage::template tile_state_t<T>;
+  using rest        = pipeline_traits<output, Rest...>;
+  using value_type  = typename rest::value_type;
+  using tile_states = typename tuple_prepend<std::optional<tile_state>,
+                                             typename rest::tile_states>::type;
+
+  static std::size_t scratch_size(std::uint32_t num_tiles) {
+    return tile_state::scratch_size(num_tiles) + rest::scratch_size(num_tiles);
+  }
+
+  static std::size_t tile_scratch_size(std::size_t n) {
+    return scratch_size_for<output>(n) + rest::tile_scratch_size(n);
+  }
+};
+
+template <typename T, typename Index = std::uint32_t, typename... Stages>
+std::size_t pipeline_scratch_size(std::size_t, std::uint32_t num_tiles) {
+  return pipeline_traits<T, Stages...>::scratch_size(num_tiles)
+       + scan_tile_state<Index>::scratch_size(num_tiles);
+}
+
+// Runs stages I and up on one tile's elements.
+template <std::size_t I = 0>
+auto run_pipeline_stages(auto const& stages,
+                         auto& states,
+                         auto&& in,
+                         workspace& tile_ws,
+                         std::uint32_t tile) {
+  if constexpr (I == std::tuple_size_v<std::remove_cvref_t<decltype(stages)>>) {
+    return in;
+  } else {
+    auto const& stage = std::get<I>(stages);
+    using T = stdr::range_value_t<decltype(in)>;
+    using U = typename std::remove_cvref_t<decltype(stage)>::template output_t<T>;
+    auto out = stage(in, tile_ws.allocate<U>(size(in)),
+                     *std::get<I>(states), tile);
+    return run_pipeline_stages<I + 1>(stages, states, out, tile_ws, tile);
+  }
+}
+
+// Runs p over in and writes what comes out of its last stage to out.
+// Returns the written part of out.
+template <typename Index = std::uint32_t, typename... Stages>
+auto run_pipeline(executor auto&& exec,
+                  pipeline<Stages...> const& p,
+                  stdr::range auto&& in,
+                  auto out,
+                  std::uint32_t num_tiles,
+                  workspace& ws) {
+  using T      = stdr::range_value_t<decltype(in)>;
+  using traits = pipeline_traits<T, Stages...>;
+
+  ws.reset(pipeline_scratch_size<T, Index, Stages...>(size(in), num_tiles));
+
+  typename traits::tile_states states;
+  [&] <std::size_t... I> (std::index_sequence<I...>) {
+    (std::get<I>(p.stages).init_tile_state(std::get<I>(states), ws, num_tiles), ...);
+  }(std::index_sequence_for<Stages...>{});
+
+  scan_tile_state<Index> sts(ws, num_tiles);
+
+  for_each_tile_in_order(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+
+      auto sub_in = range_for_tile(in, tile, num_tiles);
+
+      auto& tile_ws = tile_workspace();
+      tile_ws.reset(traits::tile_scratch_size(size(sub_in)));
+
+      auto result = run_pipeline_stages(p.stages, states, sub_in, tile_ws, tile);
+
+      sts.set_local_prefix(tile, Index(size(result)));
+
+      Index index = tile != 0 ? sts.wait_for_predecessor_prefix(tile) : 0;
+      stdr::copy(result, next(out, index));
+    });
+
+  return stdr::subrange(out, next(out, sts.inclusive_prefix(num_tiles - 1)));
+}
+
+template <typename Index = std::uint32_t, typename... Stages>
+auto run_pipeline(pipeline<Stages...> const& p,
+                  stdr::range auto&& in,
+                  auto out,
+                  std::uint32_t num_tiles,
+                  workspace& ws) {
+  return run_pipeline<Index>(default_executor(), p, in, out, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t, typename... Stages>
+auto run_pipeline(pipeline<Stages...> const& p,
+                  stdr::range auto&& in,
+                  auto out,
+                  std::uint32_t num_tiles) {
+  workspace ws;
+  return run_pipeline<Index>(p, in, out, num_tiles, ws);
+}
+
+} // namespace think_parallel
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <type_traits>
+#include <array>
+#include <concepts>
+#include <cstddef>
+
+namespace think_parallel {
+
+enum class comparison {
+  less,
+  less_equal,
+  greater,
+  greater_equal,
+  equal,
+  not_equal
+};
+
+// `e <cmp> value`. Unlike an opaque lambda, the comparison is visible to the
+// algorithms, which can substitute vectorized kernels for it.
+template <comparison Cmp, typename T>
+struct compare_with {
+  T value;
+
+  constexpr bool operator()(T const& e) const {
+    if constexpr (Cmp == comparison::less)          return e <  value;
+    if constexpr (Cmp == comparison::less_equal)    return e <= value;
+    if constexpr (Cmp == comparison::greater)       return e >  value;
+    if constexpr (Cmp == comparison::greater_equal) return e >= value;
+    if constexpr (Cmp == comparison::equal)         return e == value;
+    if constexpr (Cmp == comparison::not_equal)     return e != value;
+  }
+};
+
+template <typename T>
+constexpr auto less_than(T value) {
+  return compare_with<comparison::less, T>{value};
+}
+
+template <typename T>
+constexpr auto less_equal(T value) {
+  return compare_with<comparison::less_equal, T>{value};
+}
+
+template <typename T>
+constexpr auto greater_than(T value) {
+  return compare_with<comparison::greater, T>{value};
+}
+
+template <typename T>
+constexpr auto greater_equal(T value) {
+  return compare_with<comparison::greater_equal, T>{value};
+}
+
+template <typename T>
+constexpr auto equal_to(T value) {
+  return compare_with<comparison::equal, T>{value};
+}
+
+template <typename T>
+constexpr auto not_equal_to(T value) {
+  return compare_with<comparison::not_equal, T>{value};
+}
+
+template <typename Op>
+inline constexpr bool is_comparison_predicate_v = false;
+
+template <comparison Cmp, typename T>
+inline constexpr bool is_comparison_predicate_v<compare_with<Cmp, T>> = true;
+
+// chunk_by predicate: l and r belong to the same chunk unless either of them
+// is a delimiter, so each delimiter forms a chunk of its own. Like
+// compare_with, it lets chunk_by find chunk boundaries with vector compares.
+template <std::size_t N>
+struct delimiter_set {
+  std::array<char, N> delimiters;
+
+  constexpr bool is_delimiter(char c) const {
+    for (char d : delimiters)
+      if (c == d)
+        return true;
+    return false;
+  }
+
+  constexpr bool operator()(char l, char r) const {
+    return !(is_delimiter(l) || is_delimiter(r));
+  }
+};
+
+template <std::same_as<char>... C>
+constexpr auto not_delimited_by(C... delimiters) {
+  return delimiter_set<sizeof...(C)>{{delimiters...}};
+}
+
+template <typename Op>
+inline constexpr bool is_delimiter_predicate_v = false;
+
+template <std::size_t N>
+inline constexpr bool is_delimiter_predicate_v<delimiter_set<N>> = true;
+
+} // namespace think_parallel
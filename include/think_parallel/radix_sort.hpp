@@ -0,0 +1,220 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/scan_tile_state.hpp>
+#include <think_parallel/workspace.hpp>
+#include <think_parallel/executor.hpp>
+#include <think_parallel/partition.hpp>
+
+#include <ranges>
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <atomic>
+#include <concepts>
+#include <type_traits>
+#include <iterator>
+#include <cstdint>
+
+namespace think_parallel {
+
+inline constexpr std::uint32_t radix_bits    = 8;
+inline constexpr std::uint32_t radix_buckets = 1 << radix_bits;
+
+template <typename Index>
+using radix_counts = std::array<Index, radix_buckets>;
+
+template <typename Index>
+using radix_tile_state = scan_tile_state<radix_counts<Index>,
+                                         descriptor_layout::compact,
+                                         lookback_strategy::serial,
+                                         bucket_plus>;
+
+// The key as an unsigned integer with the same order: signed keys get their
+// sign bit flipped.
+template <std::integral Key>
+constexpr auto radix_key_bits(Key key) {
+  using U = std::make_unsigned_t<Key>;
+  auto bits = U(key);
+  if constexpr (std::is_signed_v<Key>)
+    bits ^= U(1) << (sizeof(Key) * 8 - 1);
+  return bits;
+}
+
+template <typename Key>
+inline constexpr std::uint32_t radix_digits = sizeof(Key) * 8 / radix_bits;
+
+template <typename Key, typename Index = std::uint32_t>
+std::size_t radix_sort_scratch_size(std::size_t n, std::uint32_t num_tiles) {
+  return scratch_size_for<Key>(n)
+       + scratch_size_for<radix_counts<Index>>(radix_digits<Key>)
+       + radix_digits<Key> * radix_tile_state<Index>::scratch_size(num_tiles);
+}
+
+template <typename Key, typename Value, typename Index = std::uint32_t>
+std::size_t radix_sort_by_key_scratch_size(std::size_t n, std::uint32_t num_tiles) {
+  return radix_sort_scratch_size<Key, Index>(n, num_tiles)
+       + scratch_size_for<Value>(n);
+}
+
+// The body shared by radix_sort and radix_sort_by_key, which passes the
+// values along with the keys when WithValues is set.
+//
+// One read of the keys builds the histograms of every digit. Each 8-bit
+// digit pass then counts its digit per tile, resolves the tile's offset in
+// every bucket through the lookback, adds the bucket's global start and
+// scatters the tile stably, ping-ponging between the input and a scratch
+// copy. Digits that are the same for every key are skipped.
+template <typename Index, bool WithValues>
+void radix_sort_passes(executor auto&& exec,
+                       stdr::range auto&& keys,
+                       stdr::range auto&& values,
+                       std::uint32_t num_tiles,
+                       workspace& ws) {
+  using Key   = stdr::range_value_t<decltype(keys)>;
+  using Value = stdr::range_value_t<decltype(values)>;
+  constexpr auto num_digits = radix_digits<Key>;
+
+  auto n = size(keys);
+
+  if constexpr (WithValues)
+    ws.reset(radix_sort_by_key_scratch_size<Key, Value, Index>(n, num_tiles));
+  else
+    ws.reset(radix_sort_scratch_size<Key, Index>(n, num_tiles));
+
+  auto temp_keys   = ws.allocate<Key>(n);
+  auto temp_values = ws.allocate<Value>(WithValues ? n : 0);
+  auto histograms  = ws.allocate<radix_counts<Index>>(num_digits);
+  for (auto& h : histograms)
+    h.fill(0);
+
+  auto digit = [] (Key key, std::uint32_t d) {
+    return std::uint32_t(radix_key_bits(key) >> (d * radix_bits))
+         & (radix_buckets - 1);
+  };
+
+  for_each_tile(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+      std::array<radix_counts<Index>, num_digits> local{};
+      for (auto key : range_for_tile(keys, tile, num_tiles))
+        for (std::uint32_t d = 0; d < num_digits; ++d)
+          ++local[d][digit(key, d)];
+
+      for (std::uint32_t d = 0; d < num_digits; ++d)
+        for (std::uint32_t b = 0; b < radix_buckets; ++b)
+          if (local[d][b] != 0)
+            std::atomic_ref(histograms[d][b]).fetch_add(
+              local[d][b], std::memory_order_relaxed);
+    });
+
+  auto pass = [&] (auto&& src_keys, auto&& src_values,
+                   auto dst_keys, auto dst_values,
+                   std::uint32_t d, radix_counts<Index> const& starts) {
+    radix_tile_state<Index> sts(ws, num_tiles);
+
+    for_each_tile_in_order(exec, num_tiles,
+      [&] (std::uint32_t tile) {
+
+        auto sub_keys = range_for_tile(src_keys, tile, num_tiles);
+        auto first    = begin(sub_keys);
+        auto offset   = distance(begin(src_keys), first);
+
+        radix_counts<Index> counts{};
+        for (auto key : sub_keys)
+          ++counts[digit(key, d)];
+
+        sts.set_local_prefix(tile, counts);
+
+        auto indices = tile != 0 ? sts.wait_for_predecessor_prefix(tile)
+                                 : radix_counts<Index>{};
+        for (std::uint32_t b = 0; b < radix_buckets; ++b)
+          indices[b] += starts[b];
+
+        for (std::size_t i = 0; i < size(sub_keys); ++i) {
+          auto index = indices[digit(first[i], d)]++;
+          dst_keys[index] = first[i];
+          if constexpr (WithValues)
+            dst_values[index] = begin(src_values)[offset + i];
+        }
+      });
+  };
+
+  bool in_temp = false;
+  for (std::uint32_t d = 0; d < num_digits; ++d) {
+    auto const& h = histograms[d];
+    if (stdr::find(h, Index(n)) != end(h))
+      continue;
+
+    radix_counts<Index> starts;
+    std::exclusive_scan(begin(h), end(h), begin(starts), Index(0));
+
+    if (in_temp)
+      pass(temp_keys, temp_values, begin(keys), begin(values), d, starts);
+    else
+      pass(keys, values, begin(temp_keys), begin(temp_values), d, starts);
+    in_temp = !in_temp;
+  }
+
+  if (in_temp) {
+    for_each_tile(exec, num_tiles,
+      [&] (std::uint32_t tile) {
+        stdr::copy(range_for_tile(temp_keys, tile, num_tiles),
+                   begin(range_for_tile(keys, tile, num_tiles)));
+        if constexpr (WithValues)
+          stdr::copy(range_for_tile(temp_values, tile, num_tiles),
+                     begin(range_for_tile(values, tile, num_tiles)));
+      });
+  }
+}
+
+// Sorts 32-bit or 64-bit integer keys in place; equal keys keep their order.
+template <typename Index = std::uint32_t>
+void radix_sort(executor auto&& exec,
+                stdr::random_access_range auto&& keys,
+                std::uint32_t num_tiles,
+                workspace& ws) {
+  radix_sort_passes<Index, false>(exec, keys, keys, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+void radix_sort(stdr::random_access_range auto&& keys,
+                std::uint32_t num_tiles,
+                workspace& ws) {
+  radix_sort<Index>(default_executor(), keys, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+void radix_sort(stdr::random_access_range auto&& keys,
+                std::uint32_t num_tiles) {
+  workspace ws;
+  radix_sort<Index>(keys, num_tiles, ws);
+}
+
+// Sorts keys in place and applies the same permutation to values; equal
+// keys keep their order.
+template <typename Index = std::uint32_t>
+void radix_sort_by_key(executor auto&& exec,
+                       stdr::random_access_range auto&& keys,
+                       stdr::random_access_range auto&& values,
+                       std::uint32_t num_tiles,
+                       workspace& ws) {
+  radix_sort_passes<Index, true>(exec, keys, values, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+void radix_sort_by_key(stdr::random_access_range auto&& keys,
+                       stdr::random_access_range auto&& values,
+                       std::uint32_t num_tiles,
+                       workspace& ws) {
+  radix_sort_by_key<Index>(default_executor(), keys, values, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+void radix_sort_by_key(stdr::random_access_range auto&& keys,
+                       stdr::random_access_range auto&& values,
+                       std::uint32_t num_tiles) {
+  workspace ws;
+  radix_sort_by_key<Index>(keys, values, num_tiles, ws);
+}
+
+} // namespace think_parallel
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/scan_tile_state.hpp>
+#include <think_parallel/workspace.hpp>
+#include <think_parallel/executor.hpp>
+#include <think_parallel/local_scan.hpp>
+
+#include <ranges>
+#include <algorithm>
+#include <execution>
+#include <functional>
+#include <optional>
+#include <atomic>
+#include <type_traits>
+
+namespace think_parallel {
+
+// Generic scans over an arbitrary associative op, with an optional initial
+// value and a projection applied to each input element. Elements are always
+// combined as op(earlier, later), so op need not be commutative.
+//
+// They are named scan_inclusive, scan_exclusive and transform_scan_*, not
+// after the std algorithms, since an unqualified call with std containers
+// would find both through argument-dependent lookup and be ambiguous. Call
+// them qualified, as think_parallel::scan_inclusive, all the same.
+
+template <typename Op, typename Proj, typename T, typename In>
+inline constexpr bool is_plain_sum_v =
+     (std::same_as<Op, std::plus<>> || std::same_as<Op, std::plus<T>>)
+  && std::same_as<Proj, std::identity>
+  && std::same_as<stdr::range_value_t<In>, T>
+  && is_simd_scannable_v<T>;
+
+template <typename Proj, typename In>
+using projected_value_t =
+  std::remove_cvref_t<std::invoke_result_t<Proj&, stdr::range_reference_t<In>>>;
+
+template <typename T,
+          descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial>
+std::size_t scan_scratch_size(std::size_t, std::uint32_t num_tiles) {
+  return scan_tile_state<T, Layout, Lookback>::scratch_size(num_tiles);
+}
+
+// Reduce-then-scan over the lookback engine. Tile 0 folds init in front of
+// its aggregate; every other tile is seeded with its predecessor's inclusive
+// prefix. Trailing empty tiles publish nothing, as nothing waits on them.
+// in and out may be the same range.
+template <bool Exclusive,
+          descriptor_layout Layout,
+          lookback_strategy Lookback,
+          fp_order Order,
+          typename T>
+void scan_decoupled_lookback(executor auto&& exec,
+                             stdr::range auto&& in,
+                             stdr::range auto&& out,
+                             auto op,
+                             auto proj,
+                             std::optional<T> init,
+                             std::uint32_t num_tiles,
+                             workspace& ws) {
+  using In = decltype(in);
+
+  constexpr bool plain_sum =
+    !Exclusive && is_plain_sum_v<decltype(op), decltype(proj), T, In>;
+
+  num_tiles = scan_num_tiles<T, Order>(size(in), num_tiles);
+
+  ws.reset(scan_scratch_size<T, Layout, Lookback>(size(in), num_tiles));
+
+  scan_tile_state<T, Layout, Lookback, decltype(op)> sts(ws, num_tiles, op);
+
+  auto reduce = [&] (auto&& sub_in) {
+    if constexpr (plain_sum) {
+      return local_reduce<Order>(sub_in);
+    } else {
+      std::optional<T> carry;
+      for (auto&& e : sub_in)
+        carry = carry ? op(*carry, std::invoke(proj, e))
+                      : T(std::invoke(proj, e));
+      return *carry;
+    }
+  };
+
+  // Returns the inclusive aggregate of carry and the tile, for both kinds.
+  auto scan = [&] (auto&& sub_in, auto&& sub_out, std::optional<T> carry) {
+    if constexpr (plain_sum) {
+      return carry ? local_inclusive_scan<Order>(sub_in, sub_out, *carry)
+                   : local_inclusive_scan<Order>(sub_in, sub_out);
+    } else {
+      auto o = begin(sub_out);
+      for (auto&& e : sub_in) {
+        T x = std::invoke(proj, e);
+        if constexpr (Exclusive) {
+          *o++ = *carry;
+          carry = op(*carry, x);
+        } else {
+          carry = carry ? op(*carry, x) : x;
+          *o++ = *carry;
+        }
+      }
+      return *carry;
+    }
+  };
+
+  for_each_tile_in_order(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+
+      auto sub_in  = range_for_tile(in, tile, num_tiles);
+      auto sub_out = range_for_tile(out, tile, num_tiles);
+
+      if (begin(sub_in) == end(sub_in))
+        return;
+
+      if (tile == 0) {
+        sts.set_local_prefix(tile, scan(sub_in, sub_out, init));
+        return;
+      }
+
+      if constexpr (!is_order_sensitive_v<T, Order>) {
+        if (auto pred = sts.try_predecessor_prefix(tile)) {
+          sts.set_inclusive_prefix(tile, scan(sub_in, sub_out, pred));
+          return;
+        }
+      }
+
+      sts.set_local_prefix(tile, reduce(sub_in));
+
+      T pred;
+      if constexpr (is_order_sensitive_v<T, Order>) {
+        pred = sts.wait_for_complete_predecessor_prefix(tile);
+        if constexpr (plain_sum) {
+          local_inclusive_scan_then_add(sub_in, sub_out, pred);
+          return;
+        }
+      } else {
+        pred = sts.wait_for_predecessor_prefix(tile);
+      }
+
+      scan(sub_in, sub_out, pred);
+    });
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void scan_inclusive(executor auto&& exec,
+                    stdr::range auto&& in,
+                    stdr::range auto&& out,
+                    auto op,
+                    std::uint32_t num_tiles,
+                    workspace& ws) {
+  using T = projected_value_t<std::identity, decltype(in)>;
+  scan_decoupled_lookback<false, Layout, Lookback, Order, T>(
+    exec, in, out, op, std::identity{}, std::nullopt, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void scan_inclusive(stdr::range auto&& in,
+                    stdr::range auto&& out,
+                    auto op,
+                    std::uint32_t num_tiles,
+                    workspace& ws) {
+  scan_inclusive<Layout, Lookback, Order>(
+    default_executor(), in, out, op, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void scan_inclusive(stdr::range auto&& in,
+                    stdr::range auto&& out,
+                    auto op,
+                    std::uint32_t num_tiles) {
+  workspace ws;
+  scan_inclusive<Layout, Lookback, Order>(in, out, op, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void scan_inclusive(executor auto&& exec,
+                    stdr::range auto&& in,
+                    stdr::range auto&& out,
+                    auto op,
+                    auto init,
+                    std::uint32_t num_tiles,
+                    workspace& ws) {
+  scan_decoupled_lookback<false, Layout, Lookback, Order, decltype(init)>(
+    exec, in, out, op, std::identity{}, init, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void scan_inclusive(stdr::range auto&& in,
+                    stdr::range auto&& out,
+                    auto op,
+                    auto init,
+                    std::uint32_t num_tiles,
+                    workspace& ws) {
+  scan_inclusive<Layout, Lookback, Order>(
+    default_executor(), in, out, op, init, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void scan_inclusive(stdr::range auto&& in,
+                    stdr::range auto&& out,
+                    auto op,
+                    auto init,
+                    std::uint32_t num_tiles) {
+  workspace ws;
+  scan_inclusive<Layout, Lookback, Order>(in, out, op, init, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void scan_exclusive(executor auto&& exec,
+                    stdr::range auto&& in,
+                    stdr::range auto&& out,
+                    auto init,
+                    auto op,
+                    std::uint32_t num_tiles,
+                    workspace& ws) {
+  scan_decoupled_lookback<true, Layout, Lookback, Order, decltype(init)>(
+    exec, in, out, op, std::identity{}, init, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void scan_exclusive(stdr::range auto&& in,
+                    stdr::range auto&& out,
+                    auto init,
+                    auto op,
+                    std::uint32_t num_tiles,
+                    workspace& ws) {
+  scan_exclusive<Layout, Lookback, Order>(
+    default_executor(), in, out, init, op, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void scan_exclusive(stdr::range auto&& in,
+                    stdr::range auto&& out,
+                    auto init,
+                    auto op,
+                    std::uint32_t num_tiles) {
+  workspace ws;
+  scan_exclusive<Layout, Lookback, Order>(in, out, init, op, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void transform_scan_inclusive(executor auto&& exec,
+                              stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto op,
+                              auto proj,
+                              std::uint32_t num_tiles,
+                              workspace& ws) {
+  using T = projected_value_t<decltype(proj), decltype(in)>;
+  scan_decoupled_lookback<false, Layout, Lookback, Order, T>(
+    exec, in, out, op, proj, std::nullopt, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void transform_scan_inclusive(stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto op,
+                              auto proj,
+                              std::uint32_t num_tiles,
+                              workspace& ws) {
+  transform_scan_inclusive<Layout, Lookback, Order>(
+    default_executor(), in, out, op, proj, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void transform_scan_inclusive(stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto op,
+                              auto proj,
+                              std::uint32_t num_tiles) {
+  workspace ws;
+  transform_scan_inclusive<Layout, Lookback, Order>(in, out, op, proj,
+                                                    num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void transform_scan_inclusive(executor auto&& exec,
+                              stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto op,
+                              auto proj,
+                              auto init,
+                              std::uint32_t num_tiles,
+                              workspace& ws) {
+  scan_decoupled_lookback<false, Layout, Lookback, Order, decltype(init)>(
+    exec, in, out, op, proj, init, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void transform_scan_inclusive(stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto op,
+                              auto proj,
+                              auto init,
+                              std::uint32_t num_tiles,
+                              workspace& ws) {
+  transform_scan_inclusive<Layout, Lookback, Order>(
+    default_executor(), in, out, op, proj, init, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void transform_scan_inclusive(stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto op,
+                              auto proj,
+                              auto init,
+                              std::uint32_t num_tiles) {
+  workspace ws;
+  transform_scan_inclusive<Layout, Lookback, Order>(in, out, op, proj, init,
+                                                    num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void transform_scan_exclusive(executor auto&& exec,
+                              stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto init,
+                              auto op,
+                              auto proj,
+                              std::uint32_t num_tiles,
+                              workspace& ws) {
+  scan_decoupled_lookback<true, Layout, Lookback, Order, decltype(init)>(
+    exec, in, out, op, proj, init, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void transform_scan_exclusive(stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto init,
+                              auto op,
+                              auto proj,
+                              std::uint32_t num_tiles,
+                              workspace& ws) {
+  transform_scan_exclusive<Layout, Lookback, Order>(
+    default_executor(), in, out, init, op, proj, num_tiles, ws);
+}
+
+template <descriptor_layout Layout   = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          fp_order Order             = fp_order::fastest>
+void transform_scan_exclusive(stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto init,
+                              auto op,
+                              auto proj,
+                              std::uint32_t num_tiles) {
+  workspace ws;
+  transform_scan_exclusive<Layout, Lookback, Order>(in, out, init, op, proj,
+                                                    num_tiles, ws);
+}
+
+// An inclusive scan over a sequence of blocks; carry is the last output so
+// far and seeds the next block.
+template <typename T, typename Op = std::plus<>>
+struct scan_stream {
+  Op op;
+  std::uint32_t num_tiles;
+  std::optional<T> carry;
+  workspace ws;
+
+  scan_stream(std::uint32_t num_tiles, Op op = {})
+    : op(op), num_tiles(num_tiles) {}
+
+  void operator()(stdr::range auto&& in, stdr::range auto&& out) {
+    if (begin(in) == end(in))
+      return;
+    if (carry)
+      scan_inclusive(in, out, op, *carry, num_tiles, ws);
+    else
+      scan_inclusive(in, out, op, num_tiles, ws);
+    carry = *next(begin(out), size(in) - 1);
+  }
+};
+
+} // namespace think_parallel
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/workspace.hpp>
+#include <think_parallel/instrument.hpp>
+
+#include <vector>
+#include <span>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <optional>
+#include <functional>
+#include <algorithm>
+
+namespace think_parallel {
+
+inline void spin_pause() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// compact: descriptors are adjacent in memory.
+// padded:  each descriptor occupies its own cache line.
+// packed:  status and value share one 64-bit atomic word (sizeof(T) <= 4).
+enum class descriptor_layout {
+  compact,
+  padded,
+  packed
+};
+
+// serial:   inspect one predecessor at a time, park as soon as one is
+//           unavailable.
+// windowed: inspect a window of predecessors per step, spin with bounded
+//           exponential backoff before parking.
+enum class lookback_strategy {
+  serial,
+  windowed
+};
+
+// Op must be associative; it need not be commutative. Prefixes are always
+// combined as op(earlier, later).
+template <typename T,
+          descriptor_layout Layout = descriptor_layout::compact,
+          lookback_strategy Lookback = lookback_strategy::serial,
+          typename Op = std::plus<>>
+struct scan_tile_state {
+  enum status : std::uint32_t {
+    status_unavailable,
+    status_local,
+    status_complete
+  };
+
+  struct compact_descriptor {
+    T local = {};
+    T complete = {};
+    std::atomic<status> state = status_unavailable;
+  };
+
+  struct alignas(cache_line_size) padded_descriptor : compact_descriptor {};
+
+  struct packed_descriptor {
+    std::atomic<std::uint64_t> word = 0;
+  };
+
+  static_assert(Layout != descriptor_layout::packed
+             || (sizeof(T) <= sizeof(std::uint32_t)
+                 && std::is_trivially_copyable_v<T>),
+                "packed descriptors require a trivially copyable T of at most 4 bytes");
+
+  using descriptor = std::conditional_t<
+    Layout == descriptor_layout::compact, compact_descriptor,
+    std::conditional_t<
+      Layout == descriptor_layout::padded, padded_descriptor,
+      packed_descriptor>>;
+
+  using raw_state = std::conditional_t<
+    Layout == descriptor_layout::packed, std::uint64_t, status>;
+
+  static constexpr raw_state raw_unavailable = raw_state(0);
+
+  static constexpr std::uint32_t window =
+    Layout == descriptor_layout::packed
+      ? cache_line_size / sizeof(std::uint64_t) : 4;
+  static constexpr std::uint32_t spin_limit  = 16;
+  static constexpr std::uint32_t max_backoff = 64;
+
+  std::vector<descriptor> owned;
+  std::span<descriptor> prefixes;
+  std::atomic<std::uint32_t> parked = 0;
+  [[no_unique_address]] Op op;
+
+  scan_tile_state(std::uint32_t num_tiles, Op op = {})
+    : owned(num_tiles), prefixes(owned), op(op) {}
+
+  scan_tile_state(workspace& ws, std::uint32_t num_tiles, Op op = {})
+    : prefixes(ws.allocate<descriptor>(num_tiles)), op(op) {}
+
+  static std::size_t scratch_size(std::uint32_t num_tiles) {
+    return scratch_size_for<descriptor>(num_tiles);
+  }
+
+  static std::uint64_t pack(status s, T value) {
+    std::uint32_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(T));
+    return (std::uint64_t(s) << 32) | bits;
+  }
+
+  static status unpack_status(std::uint64_t word) {
+    return status(word >> 32);
+  }
+
+  static T unpack_value(std::uint64_t word) {
+    T value;
+    std::uint32_t bits = std::uint32_t(word);
+    std::memcpy(&value, &bits, sizeof(T));
+    return value;
+  }
+
+  auto& flag(std::uint32_t p) {
+    if constexpr (Layout == descriptor_layout::packed)
+      return prefixes[p].word;
+    else
+      return prefixes[p].state;
+  }
+
+  raw_state load(std::uint32_t p) {
+    if constexpr (Layout == descriptor_layout::packed)
+      return flag(p).load(std::memory_order_relaxed);
+    else
+      return flag(p).load(std::memory_order_acquire);
+  }
+
+  static status status_of(raw_state raw) {
+    if constexpr (Layout == descriptor_layout::packed)
+      return unpack_status(raw);
+    else
+      return raw;
+  }
+
+  T value_of(std::uint32_t p, raw_state raw) {
+    if constexpr (Layout == descriptor_layout::packed)
+      return unpack_value(raw);
+    else
+      return raw == status_local ? prefixes[p].local : prefixes[p].complete;
+  }
+
+  void publish(std::uint32_t i, status s, T value) {
+    instrument_publish();
+    auto& d = prefixes[i];
+    if constexpr (Layout == descriptor_layout::packed) {
+      d.word.store(pack(s, value), std::memory_order_release);
+    } else {
+      if (s == status_local)
+        d.local = value;
+      else
+        d.complete = value;
+      d.state.store(s, std::memory_order_release);
+    }
+
+    // Pairs with the increment in park: either the parked thread sees our
+    // store, or we see it parked and wake it.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked.load(std::memory_order_relaxed) != 0)
+      flag(i).notify_all();
+  }
+
+  void park(std::uint32_t p, raw_state expected = raw_unavailable) {
+    auto since = trace_clock();
+    parked.fetch_add(1, std::memory_order_seq_cst);
+    flag(p).wait(expected, std::memory_order_seq_cst);
+    parked.fetch_sub(1, std::memory_order_relaxed);
+    instrument_wait(since, true);
+  }
+
+  // Blocks until tile p has published something, then returns its status
+  // and the matching (local or complete) value.
+  std::pair<status, T> wait_for(std::uint32_t p) {
+    auto raw = load(p);
+    while (status_of(raw) == status_unavailable) {
+      park(p);
+      raw = load(p);
+    }
+    return {status_of(raw), value_of(p, raw)};
+  }
+
+  void set_local_prefix(std::uint32_t i, T local) {
+    if (i == 0)
+      publish(i, status_complete, local);
+    else
+      publish(i, status_local, local);
+  }
+
+  // Publishes tile i's inclusive prefix directly, for tiles that resolved
+  // their predecessor before computing their own aggregate.
+  void set_inclusive_prefix(std::uint32_t i, T inclusive) {
+    publish(i, status_complete, inclusive);
+  }
+
+  // The exclusive prefix of tile i if its immediate predecessor is already
+  // complete; never blocks.
+  std::optional<T> try_predecessor_prefix(std::uint32_t i) {
+    if (i == 0)
+      return std::nullopt;
+    auto raw = load(i - 1);
+    if (status_of(raw) != status_complete)
+      return std::nullopt;
+    instrument_lookback(1);
+    return value_of(i - 1, raw);
+  }
+
+  // Like wait_for_predecessor_prefix, but only ever consumes the immediate
+  // predecessor's complete prefix, so the combining order is independent of
+  // the tile schedule.
+  T wait_for_complete_predecessor_prefix(std::uint32_t i) {
+    auto raw = load(i - 1);
+    while (status_of(raw) != status_complete) {
+      park(i - 1, raw);
+      raw = load(i - 1);
+    }
+    instrument_lookback(1);
+    auto predecessor_prefix = value_of(i - 1, raw);
+    publish(i, status_complete, op(predecessor_prefix, local_prefix(i)));
+    return predecessor_prefix;
+  }
+
+  T local_prefix(std::uint32_t i) {
+    if constexpr (Layout == descriptor_layout::packed)
+      return unpack_value(prefixes[i].word.load(std::memory_order_relaxed));
+    else
+      return prefixes[i].local;
+  }
+
+  T wait_for_predecessor_prefix(std::uint32_t i) {
+    std::optional<T> predecessor_prefix;
+    auto prepend = [&] (T value) {
+      instrument_lookback(1);
+      predecessor_prefix = predecessor_prefix ? op(value, *predecessor_prefix)
+                                              : value;
+    };
+
+    if constexpr (Lookback == lookback_strategy::serial) {
+      for (auto p = i; p-- > 0;) {
+        auto [state, value] = wait_for(p);
+        prepend(value);
+        if (state == status_complete)
+          break;
+      }
+    } else {
+      std::uint32_t spins = 0;
+      std::uint32_t backoff = 1;
+      for (auto window_end = i; window_end > 0;) {
+        auto window_begin = window_end > window ? window_end - window : 0;
+
+        raw_state raws[window];
+        for (auto p = window_begin; p < window_end; ++p)
+          raws[p - window_begin] = load(p);
+
+        // Only the predecessors above the nearest complete one matter.
+        auto stop = window_begin;
+        std::uint32_t blocked = window_end;
+        for (auto p = window_end; p-- > window_begin;) {
+          auto s = status_of(raws[p - window_begin]);
+          if (s == status_unavailable) {
+            blocked = p;
+            break;
+          }
+          if (s == status_complete) {
+            stop = p;
+            break;
+          }
+        }
+
+        if (blocked != window_end) {
+          if (spins < spin_limit) {
+            auto since = trace_clock();
+            for (std::uint32_t k = 0; k < backoff; ++k)
+              spin_pause();
+            instrument_wait(since, false);
+            backoff = std::min(backoff * 2, max_backoff);
+            ++spins;
+          } else {
+            park(blocked);
+          }
+          continue;
+        }
+
+        for (auto p = window_end; p-- > stop;)
+          prepend(value_of(p, raws[p - window_begin]));
+
+        if (status_of(raws[stop - window_begin]) == status_complete)
+          break;
+
+        window_end = window_begin;
+        spins = 0;
+        backoff = 1;
+      }
+    }
+
+    publish(i, status_complete, op(*predecessor_prefix, local_prefix(i)));
+
+    return *predecessor_prefix;
+  }
+
+  T inclusive_prefix(std::uint32_t i) {
+    return wait_for(i).second;
+  }
+};
+
+} // namespace think_parallel
@@ -0,0 +1,400 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+#include <think_parallel/scan_tile_state.hpp>
+#include <think_parallel/workspace.hpp>
+#include <think_parallel/executor.hpp>
+
+#include <ranges>
+#include <algorithm>
+#include <execution>
+#include <functional>
+#include <optional>
+#include <atomic>
+#include <utility>
+#include <tuple>
+
+namespace think_parallel {
+
+// The running state of a segmented scan: how many segment heads have been
+// seen so far, and the op-reduction of the elements since the latest one.
+template <typename Index, typename T>
+struct segment_prefix {
+  Index count = 0;
+  T value = {};
+};
+
+// Lifts an associative op to segment_prefix. Like interval's operator+, the
+// right operand wins as soon as it contains a head.
+template <typename Op>
+struct segmented_op {
+  [[no_unique_address]] Op op;
+
+  template <typename Index, typename T>
+  segment_prefix<Index, T> operator()(segment_prefix<Index, T> l,
+                                      segment_prefix<Index, T> r) const {
+    return {Index(l.count + r.count),
+            r.count ? r.value : T(op(l.value, r.value))};
+  }
+};
+
+template <typename Index, typename T>
+std::size_t segmented_scan_scratch_size(std::size_t, std::uint32_t num_tiles) {
+  return scan_tile_state<segment_prefix<Index, T>>::scratch_size(num_tiles);
+}
+
+// Single-pass segmented scan over the indices [0, n). is_head(i) tells
+// whether element i starts a segment (element 0 always does) and value(i, h)
+// yields its contribution. Each tile reduces, publishes its aggregate,
+// resolves its predecessor through the lookback and then rescans, calling
+// emit(i, h, before, after) with the state on either side of element i.
+template <typename Index, typename T>
+void segmented_scan_decoupled_lookback(executor auto&& exec,
+                                       std::size_t n,
+                                       auto is_head,
+                                       auto value,
+                                       auto op,
+                                       std::uint32_t num_tiles,
+                                       workspace& ws,
+                                       auto emit) {
+  using state = segment_prefix<Index, T>;
+
+  ws.reset(segmented_scan_scratch_size<Index, T>(n, num_tiles));
+
+  segmented_op<decltype(op)> seg_op{op};
+  scan_tile_state<state, descriptor_layout::compact, lookback_strategy::serial,
+                  segmented_op<decltype(op)>> sts(ws, num_tiles, seg_op);
+
+  auto step = [&] (std::optional<state>& carry, std::size_t i) {
+    bool h = i == 0 || is_head(i);
+    state x{Index(h), value(i, h)};
+    auto before = carry;
+    carry = carry ? seg_op(*carry, x) : x;
+    return std::tuple{h, before};
+  };
+
+  for_each_tile_in_order(exec, num_tiles,
+    [&] (std::uint32_t tile) {
+
+      auto indices = range_for_tile(stdv::iota(std::size_t(0), n),
+                                    tile, num_tiles);
+
+      // Empty tiles only ever trail the input, so nothing waits on them.
+      if (begin(indices) == end(indices))
+        return;
+
+      auto scan = [&] (std::optional<state> carry) {
+        for (auto i : indices) {
+          auto [h, before] = step(carry, i);
+          emit(i, h, before, *carry);
+        }
+        return *carry;
+      };
+
+      if (tile == 0) {
+        sts.set_local_prefix(tile, scan(std::nullopt));
+        return;
+      }
+
+      if (auto pred = sts.try_predecessor_prefix(tile)) {
+        sts.set_inclusive_prefix(tile, scan(pred));
+        return;
+      }
+
+      std::optional<state> local;
+      for (auto i : indices)
+        step(local, i);
+      sts.set_local_prefix(tile, *local);
+
+      scan(sts.wait_for_predecessor_prefix(tile));
+    });
+}
+
+auto adjacent_key_heads(stdr::range auto&& keys, auto key_eq) {
+  return [first = begin(keys), key_eq] (std::size_t i) {
+    return !key_eq(first[i - 1], first[i]);
+  };
+}
+
+// Segmented scans whose segment heads are marked by a range of flags.
+
+template <typename Index = std::uint32_t>
+void segmented_inclusive_scan(executor auto&& exec,
+                              stdr::range auto&& heads,
+                              stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto op,
+                              std::uint32_t num_tiles,
+                              workspace& ws) {
+  using T = stdr::range_value_t<decltype(in)>;
+  segmented_scan_decoupled_lookback<Index, T>(exec, size(in),
+    [h = begin(heads)] (std::size_t i) { return bool(h[i]); },
+    [x = begin(in)] (std::size_t i, bool) { return T(x[i]); },
+    op, num_tiles, ws,
+    [o = begin(out)] (std::size_t i, bool, auto, auto after)
+    { o[i] = after.value; });
+}
+
+template <typename Index = std::uint32_t>
+void segmented_inclusive_scan(stdr::range auto&& heads,
+                              stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto op,
+                              std::uint32_t num_tiles,
+                              workspace& ws) {
+  segmented_inclusive_scan<Index>(
+    default_executor(), heads, in, out, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+void segmented_inclusive_scan(stdr::range auto&& heads,
+                              stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto op,
+                              std::uint32_t num_tiles) {
+  workspace ws;
+  segmented_inclusive_scan<Index>(heads, in, out, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+void segmented_exclusive_scan(executor auto&& exec,
+                              stdr::range auto&& heads,
+                              stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto init,
+                              auto op,
+                              std::uint32_t num_tiles,
+                              workspace& ws) {
+  using T = decltype(init);
+  segmented_scan_decoupled_lookback<Index, T>(exec, size(in),
+    [h = begin(heads)] (std::size_t i) { return bool(h[i]); },
+    [x = begin(in), init, op] (std::size_t i, bool h)
+    { return h ? T(op(init, x[i])) : T(x[i]); },
+    op, num_tiles, ws,
+    [o = begin(out), init] (std::size_t i, bool h, auto before, auto)
+    { o[i] = h ? init : before->value; });
+}
+
+template <typename Index = std::uint32_t>
+void segmented_exclusive_scan(stdr::range auto&& heads,
+                              stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto init,
+                              auto op,
+                              std::uint32_t num_tiles,
+                              workspace& ws) {
+  segmented_exclusive_scan<Index>(
+    default_executor(), heads, in, out, init, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+void segmented_exclusive_scan(stdr::range auto&& heads,
+                              stdr::range auto&& in,
+                              stdr::range auto&& out,
+                              auto init,
+                              auto op,
+                              std::uint32_t num_tiles) {
+  workspace ws;
+  segmented_exclusive_scan<Index>(heads, in, out, init, op, num_tiles, ws);
+}
+
+// Segmented scans whose segments are runs of adjacent keys for which
+// key_eq(l, r) holds, as with chunk_by.
+
+template <typename Index = std::uint32_t>
+void inclusive_scan_by_key(executor auto&& exec,
+                           stdr::range auto&& keys,
+                           stdr::range auto&& in,
+                           stdr::range auto&& out,
+                           auto key_eq,
+                           auto op,
+                           std::uint32_t num_tiles,
+                           workspace& ws) {
+  using T = stdr::range_value_t<decltype(in)>;
+  segmented_scan_decoupled_lookback<Index, T>(exec, size(in),
+    adjacent_key_heads(keys, key_eq),
+    [x = begin(in)] (std::size_t i, bool) { return T(x[i]); },
+    op, num_tiles, ws,
+    [o = begin(out)] (std::size_t i, bool, auto, auto after)
+    { o[i] = after.value; });
+}
+
+template <typename Index = std::uint32_t>
+void inclusive_scan_by_key(stdr::range auto&& keys,
+                           stdr::range auto&& in,
+                           stdr::range auto&& out,
+                           auto key_eq,
+                           auto op,
+                           std::uint32_t num_tiles,
+                           workspace& ws) {
+  inclusive_scan_by_key<Index>(
+    default_executor(), keys, in, out, key_eq, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+void inclusive_scan_by_key(stdr::range auto&& keys,
+                           stdr::range auto&& in,
+                           stdr::range auto&& out,
+                           auto key_eq,
+                           auto op,
+                           std::uint32_t num_tiles) {
+  workspace ws;
+  inclusive_scan_by_key<Index>(keys, in, out, key_eq, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+void exclusive_scan_by_key(executor auto&& exec,
+                           stdr::range auto&& keys,
+                           stdr::range auto&& in,
+                           stdr::range auto&& out,
+                           auto init,
+                           auto key_eq,
+                           auto op,
+                           std::uint32_t num_tiles,
+                           workspace& ws) {
+  using T = decltype(init);
+  segmented_scan_decoupled_lookback<Index, T>(exec, size(in),
+    adjacent_key_heads(keys, key_eq),
+    [x = begin(in), init, op] (std::size_t i, bool h)
+    { return h ? T(op(init, x[i])) : T(x[i]); },
+    op, num_tiles, ws,
+    [o = begin(out), init] (std::size_t i, bool h, auto before, auto)
+    { o[i] = h ? init : before->value; });
+}
+
+template <typename Index = std::uint32_t>
+void exclusive_scan_by_key(stdr::range auto&& keys,
+                           stdr::range auto&& in,
+                           stdr::range auto&& out,
+                           auto init,
+                           auto key_eq,
+                           auto op,
+                           std::uint32_t num_tiles,
+                           workspace& ws) {
+  exclusive_scan_by_key<Index>(
+    default_executor(), keys, in, out, init, key_eq, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+void exclusive_scan_by_key(stdr::range auto&& keys,
+                           stdr::range auto&& in,
+                           stdr::range auto&& out,
+                           auto init,
+                           auto key_eq,
+                           auto op,
+                           std::uint32_t num_tiles) {
+  workspace ws;
+  exclusive_scan_by_key<Index>(keys, in, out, init, key_eq, op, num_tiles, ws);
+}
+
+// Writes the first key and the op-reduction of each run of adjacent keys.
+// The head of a segment writes its key and its last element writes the
+// value, both at the segment's index, so each output is written once.
+template <typename Index, typename T>
+auto reduce_segments_by_key(executor auto&& exec,
+                            stdr::range auto&& keys,
+                            auto value,
+                            stdr::range auto&& keys_out,
+                            stdr::range auto&& values_out,
+                            auto key_eq,
+                            auto op,
+                            std::uint32_t num_tiles,
+                            workspace& ws) {
+  auto n = size(keys);
+  auto is_head = adjacent_key_heads(keys, key_eq);
+
+  Index num_segments = 0;
+
+  segmented_scan_decoupled_lookback<Index, T>(exec, n, is_head, value,
+    op, num_tiles, ws,
+    [&, k = begin(keys), ko = begin(keys_out), vo = begin(values_out)]
+    (std::size_t i, bool h, auto, auto after) {
+      if (h)
+        ko[after.count - 1] = k[i];
+      if (i + 1 == n || is_head(i + 1))
+        vo[after.count - 1] = after.value;
+      if (i + 1 == n)
+        num_segments = after.count;
+    });
+
+  return std::pair{
+    stdr::subrange(begin(keys_out), next(begin(keys_out), num_segments)),
+    stdr::subrange(begin(values_out), next(begin(values_out), num_segments))};
+}
+
+template <typename Index = std::uint32_t>
+auto reduce_by_key(executor auto&& exec,
+                   stdr::range auto&& keys,
+                   stdr::range auto&& in,
+                   stdr::range auto&& keys_out,
+                   stdr::range auto&& values_out,
+                   auto key_eq,
+                   auto op,
+                   std::uint32_t num_tiles,
+                   workspace& ws) {
+  using T = stdr::range_value_t<decltype(in)>;
+  return reduce_segments_by_key<Index, T>(exec, keys,
+    [x = begin(in)] (std::size_t i, bool) { return T(x[i]); },
+    keys_out, values_out, key_eq, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+auto reduce_by_key(stdr::range auto&& keys,
+                   stdr::range auto&& in,
+                   stdr::range auto&& keys_out,
+                   stdr::range auto&& values_out,
+                   auto key_eq,
+                   auto op,
+                   std::uint32_t num_tiles,
+                   workspace& ws) {
+  return reduce_by_key<Index>(
+    default_executor(), keys, in, keys_out, values_out, key_eq, op, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+auto reduce_by_key(stdr::range auto&& keys,
+                   stdr::range auto&& in,
+                   stdr::range auto&& keys_out,
+                   stdr::range auto&& values_out,
+                   auto key_eq,
+                   auto op,
+                   std::uint32_t num_tiles) {
+  workspace ws;
+  return reduce_by_key<Index>(keys, in, keys_out, values_out, key_eq, op,
+                              num_tiles, ws);
+}
+
+// Each run of equal adjacent elements and its length.
+template <typename Index = std::uint32_t>
+auto run_length_encode(executor auto&& exec,
+                       stdr::range auto&& in,
+                       stdr::range auto&& unique_out,
+                       stdr::range auto&& counts_out,
+                       std::uint32_t num_tiles,
+                       workspace& ws) {
+  using Count = stdr::range_value_t<decltype(counts_out)>;
+  return reduce_segments_by_key<Index, Count>(exec, in,
+    [] (std::size_t, bool) { return Count(1); },
+    unique_out, counts_out, std::equal_to<>{}, std::plus<>{}, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+auto run_length_encode(stdr::range auto&& in,
+                       stdr::range auto&& unique_out,
+                       stdr::range auto&& counts_out,
+                       std::uint32_t num_tiles,
+                       workspace& ws) {
+  return run_length_encode<Index>(
+    default_executor(), in, unique_out, counts_out, num_tiles, ws);
+}
+
+template <typename Index = std::uint32_t>
+auto run_length_encode(stdr::range auto&& in,
+                       stdr::range auto&& unique_out,
+                       stdr::range auto&& counts_out,
+                       std::uint32_t num_tiles) {
+  workspace ws;
+  return run_length_encode<Index>(in, unique_out, counts_out, num_tiles, ws);
+}
+
+} // namespace think_parallel
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdlib>
+#include <string_view>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+  #define THINK_PARALLEL_X86_SIMD 1
+  #include <immintrin.h>
+  #define THINK_PARALLEL_TARGET_AVX2 \
+    __attribute__((target("avx2,bmi,bmi2,popcnt")))
+  #define THINK_PARALLEL_TARGET_AVX512 \
+    __attribute__((target("avx512f,avx512bw,avx512vl,avx2,bmi,bmi2,popcnt")))
+#else
+  #define THINK_PARALLEL_X86_SIMD 0
+#endif
+
+namespace think_parallel {
+
+enum class simd_isa {
+  scalar,
+  avx2,
+  avx512
+};
+
+inline std::string_view to_string(simd_isa isa) {
+  switch (isa) {
+    case simd_isa::avx512: return "avx512";
+    case simd_isa::avx2:   return "avx2";
+    default:               return "scalar";
+  }
+}
+
+// The best instruction set supported by the CPU, optionally capped by the
+// THINK_PARALLEL_SIMD_ISA environment variable (scalar, avx2 or avx512).
+inline simd_isa detect_simd_isa() {
+  auto isa = simd_isa::scalar;
+
+#if THINK_PARALLEL_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2")
+   && __builtin_cpu_supports("popcnt"))
+    isa = simd_isa::avx2;
+  if (isa == simd_isa::avx2 && __builtin_cpu_supports("avx512f")
+   && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl"))
+    isa = simd_isa::avx512;
+#endif
+
+  if (auto env = std::getenv("THINK_PARALLEL_SIMD_ISA")) {
+    std::string_view cap(env);
+    if (cap == "scalar")
+      isa = simd_isa::scalar;
+    else if (cap == "avx2" && isa == simd_isa::avx512)
+      isa = simd_isa::avx2;
+  }
+
+  return isa;
+}
+
+inline simd_isa active_simd_isa() {
+  static simd_isa const isa = detect_simd_isa();
+  return isa;
+}
+
+} // namespace think_parallel
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <think_parallel/simd.hpp>
+#include <think_parallel/predicates.hpp>
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace think_parallel {
+
+template <typename Op, typename T>
+inline constexpr bool is_simd_compactable_v = false;
+
+template <comparison Cmp>
+inline constexpr bool
+  is_simd_compactable_v<compare_with<Cmp, std::int32_t>, std::int32_t> = true;
+
+template <comparison Cmp>
+std::size_t count_if_scalar(std::int32_t const* first, std::size_t n,
+                            compare_with<Cmp, std::int32_t> op) {
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < n; ++i)
+    count += op(first[i]);
+  return count;
+}
+
+template <comparison Cmp>
+std::int32_t* copy_if_scalar(std::int32_t const* first, std::size_t n,
+                             std::int32_t* out,
+                             compare_with<Cmp, std::int32_t> op) {
+  for (std::size_t i = 0; i < n; ++i)
+    if (op(first[i]))
+      *out++ = first[i];
+  return out;
+}
+
+#if THINK_PARALLEL_X86_SIMD
+
+// For each 8-bit lane mask, the indices of its set lanes packed into the low
+// bytes; the shuffle-table emulation of a compress for AVX2.
+inline constexpr auto compress_lut_8x32 = [] {
+  std::array<std::uint64_t, 256> lut{};
+  for (unsigned m = 0; m < 256; ++m) {
+    unsigned k = 0;
+    for (unsigned lane = 0; lane < 8; ++lane)
+      if (m & (1U << lane))
+        lut[m] |= std::uint64_t(lane) << (8 * k++);
+  }
+  return lut;
+}();
+
+template <comparison Cmp>
+THINK_PARALLEL_TARGET_AVX2 inline
+std::uint32_t compare_mask_avx2(__m256i v, __m256i k) {
+  __m256i r;
+  bool invert = false;
+  if constexpr (Cmp == comparison::less)
+    r = _mm256_cmpgt_epi32(k, v);
+  else if constexpr (Cmp == comparison::greater)
+    r = _mm256_cmpgt_epi32(v, k);
+  else if constexpr (Cmp == comparison::less_equal)
+    r = _mm256_cmpgt_epi32(v, k), invert = true;
+  else if constexpr (Cmp == comparison::greater_equal)
+    r = _mm256_cmpgt_epi32(k, v), invert = true;
+  else if constexpr (Cmp == comparison::equal)
+    r = _mm256_cmpeq_epi32(v, k);
+  else
+    r = _mm256_cmpeq_epi32(v, k), invert = true;
+  std::uint32_t m = _mm256_movemask_ps(_mm256_castsi256_ps(r));
+  return invert ? ~m & 0xFF : m;
+}
+
+template <comparison Cmp>
+THINK_PARALLEL_TARGET_AVX2
+std::size_t count_if_avx2(std::int32_t const* first, std::size_t n,
+                          compare_with<Cmp, std::int32_t> op) {
+  auto k = _mm256_set1_epi32(op.value);
+  std::size_t count = 0;
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(first + i));
+    count += _mm_popcnt_u32(compare_mask_avx2<Cmp>(v, k));
+  }
+  return count + count_if_scalar(first + i, n - i, op);
+}
+
+template <comparison Cmp>
+THINK_PARALLEL_TARGET_AVX2
+std::int32_t* copy_if_avx2(std::int32_t const* first, std::size_t n,
+                           std::int32_t* out,
+                           compare_with<Cmp, std::int32_t> op) {
+  auto k    = _mm256_set1_epi32(op.value);
+  auto iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(first + i));
+    auto m = compare_mask_avx2<Cmp>(v, k);
+    auto c = static_cast<int>(_mm_popcnt_u32(m));
+    auto perm = _mm256_cvtepu8_epi32(
+      _mm_cvtsi64_si128(static_cast<long long>(compress_lut_8x32[m])));
+    auto packed = _mm256_permutevar8x32_epi32(v, perm);
+    // Masked store: lanes past the match count must not touch memory that
+    // may belong to the next tile's output.
+    _mm256_maskstore_epi32(reinterpret_cast<int*>(out),
+                           _mm256_cmpgt_epi32(_mm256_set1_epi32(c), iota),
+                           packed);
+    out += c;
+  }
+  return copy_if_scalar(first + i, n - i, out, op);
+}
+
+template <comparison Cmp>
+constexpr int avx512_cmpint() {
+  if constexpr (Cmp == comparison::less)          return _MM_CMPINT_LT;
+  if constexpr (Cmp == comparison::less_equal)    return _MM_CMPINT_LE;
+  if constexpr (Cmp == comparison::greater)       return _MM_CMPINT_NLE;
+  if constexpr (Cmp == comparison::greater_equal) return _MM_CMPINT_NLT;
+  if constexpr (Cmp == comparison::equal)         return _MM_CMPINT_EQ;
+  if constexpr (Cmp == comparison::not_equal)     return _MM_CMPINT_NE;
+}
+
+template <comparison Cmp>
+THINK_PARALLEL_TARGET_AVX512
+std::size_t count_if_avx512(std::int32_t const* first, std::size_t n,
+                            compare_with<Cmp, std::int32_t> op) {
+  auto k = _mm512_set1_epi32(op.value);
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < n; i += 16) {
+    __mmask16 valid = n - i >= 16 ? 0xFFFF : (1U << (n - i)) - 1;
+    auto v = _mm512_maskz_loadu_epi32(valid, first + i);
+    auto m = _mm512_mask_cmp_epi32_mask(valid, v, k, avx512_cmpint<Cmp>());
+    count += _mm_popcnt_u32(m);
+  }
+  return count;
+}
+
+template <comparison Cmp>
+THINK_PARALLEL_TARGET_AVX512
+std::int32_t* copy_if_avx512(std::int32_t const* first, std::size_t n,
+                             std::int32_t* out,
+                             compare_with<Cmp, std::int32_t> op) {
+  auto k = _mm512_set1_epi32(op.value);
+  for (std::size_t i = 0; i < n; i += 16) {
+    __mmask16 valid = n - i >= 16 ? 0xFFFF : (1U << (n - i)) - 1;
+    auto v = _mm512_maskz_loadu_epi32(valid, first + i);
+    auto m = _mm512_mask_cmp_epi32_mask(valid, v, k, avx512_cmpint<Cmp>());
+    _mm512_mask_compressstoreu_epi32(out, m, v);
+    out += _mm_popcnt_u32(m);
+  }
+  return out;
+}
+
+#endif
+
+template <comparison Cmp>
+std::size_t count_if_simd(std::int32_t const* first, std::size_t n,
+                          compare_with<Cmp, std::int32_t> op) {
+#if THINK_PARALLEL_X86_SIMD
+  switch (active_simd_isa()) {
+    case simd_isa::avx512: return count_if_avx512(first, n, op);
+    case simd_isa::avx2:   return count_if_avx2(first, n, op);
+    default:               break;
+  }
+#endif
+  return count_if_scalar(first, n, op);
+}
+
+template <comparison Cmp>
+std::int32_t* copy_if_simd(std::int32_t const* first, std::size_t n,
+                           std::int32_t* out,
+                           compare_with<Cmp, std::int32_t> op) {
+#if THINK_PARALLEL_X86_SIMD
+  switch (active_simd_isa()) {
+    case simd_isa::avx512: return copy_if_avx512(first, n, out, op);
+    case simd_isa::avx2:   return copy_if_avx2(first, n, out, op);
+    default:               break;
+  }
+#endif
+  return copy_if_scalar(first, n, out, op);
+}
+
+} // namespace think_parallel
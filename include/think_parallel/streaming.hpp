@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <thread>
+#include <semaphore>
+#include <atomic>
+#include <exception>
+#include <istream>
+#include <algorithm>
+#include <cstddef>
+
+namespace think_parallel {
+
+// Block input for the streaming front ends (scan_stream, copy_if_stream,
+// chunk_by_stream), which process one block of a longer input at a time and
+// carry whatever the next block needs to continue where the last stopped, so
+// memory is bounded by the block size rather than the input.
+
+// Reads fixed-size blocks of T with read(std::span<T>), which returns the
+// number of elements it filled and 0 at the end of the input, and calls
+// f(block) on each. One reader thread, started once for the whole input,
+// fills two buffers in turn, so that the next read overlaps the processing
+// of the current block. An exception from read is rethrown here.
+template <typename T>
+void for_each_block(auto read, std::size_t block_size, auto f) {
+  std::vector<T> buffers[2] = {std::vector<T>(block_size),
+                               std::vector<T>(block_size)};
+  std::size_t filled[2] = {};
+  std::exception_ptr read_error;
+
+  std::counting_semaphore<> empty(2), full(0);
+  std::atomic<bool> done{false};
+
+  std::jthread reader([&] {
+    for (int b = 0; ; b ^= 1) {
+      empty.acquire();
+      if (done)
+        return;
+      try {
+        filled[b] = read(std::span<T>(buffers[b]));
+      } catch (...) {
+        read_error = std::current_exception();
+        filled[b] = 0;
+      }
+      full.release();
+      if (filled[b] == 0)
+        return;
+    }
+  });
+
+  // Wakes the reader up to stop it, however the loop below is left, before
+  // it is joined.
+  struct stop_reader {
+    std::atomic<bool>& done;
+    std::counting_semaphore<>& empty;
+
+    ~stop_reader() {
+      done = true;
+      empty.release();
+    }
+  } stop{done, empty};
+
+  for (int b = 0; ; b ^= 1) {
+    full.acquire();
+    if (filled[b] == 0)
+      break;
+    f(std::span<T const>(buffers[b].data(), filled[b]));
+    empty.release();
+  }
+
+  if (read_error)
+    std::rethrow_exception(read_error);
+}
+
+// A read function for for_each_block that reads raw T from a binary stream.
+template <typename T>
+auto stream_reader(std::istream& is) {
+  return [&is] (std::span<T> buffer) {
+    is.read(reinterpret_cast<char*>(buffer.data()), buffer.size_bytes());
+    return std::size_t(is.gcount()) / sizeof(T);
+  };
+}
+
+// A read function for for_each_block that reads consecutive pieces of an
+// input already in memory, in place of a file.
+template <typename T>
+auto span_reader(std::span<T const> in) {
+  return [in] (std::span<T> buffer) mutable {
+    auto n = std::min(buffer.size(), in.size());
+    std::copy_n(in.data(), n, buffer.data());
+    in = in.subspan(n);
+    return n;
+  };
+}
+
+} // namespace think_parallel
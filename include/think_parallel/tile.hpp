@@ -0,0 +1,47 @@
+#pragma once
+
+#include <ranges>
+#include <algorithm>
+#include <execution>
+#include <cstdint>
+#include <concepts>
+
+namespace think_parallel {
+
+namespace stdr = std::ranges;
+namespace stdv = std::views;
+namespace stde = std::execution;
+
+using stdr::begin;
+using stdr::end;
+using stdr::next;
+using stdr::size;
+using stdr::distance;
+
+inline constexpr std::size_t cache_line_size = 64;
+
+// Large tiles are rounded up to a multiple of tile_alignment elements, so for
+// element sizes that are powers of two every tile of a page-aligned input
+// starts on a page boundary and faults in only its own pages. The rounding
+// only applies once it costs at most 1/64 of a tile.
+inline constexpr std::size_t tile_alignment = 4096;
+
+constexpr auto tile_size_for(std::integral auto n, std::uint32_t num_tiles) {
+  auto tile_size = (n + num_tiles - 1) / num_tiles;
+  using size_type = decltype(tile_size);
+  constexpr auto alignment = size_type(tile_alignment);
+  if (tile_size >= 64 * alignment)
+    tile_size = (tile_size + alignment - 1) / alignment * alignment;
+  return tile_size;
+}
+
+auto range_for_tile(stdr::range auto&& in,
+                    std::uint32_t tile,
+                    std::uint32_t num_tiles) {
+  auto tile_size = tile_size_for(size(in), num_tiles);
+  auto start     = std::min(tile * tile_size, size(in));
+  auto end       = std::min((tile + 1) * tile_size, size(in));
+  return stdr::subrange(next(begin(in), start), next(begin(in), end));
+}
+
+} // namespace think_parallel
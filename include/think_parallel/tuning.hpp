@@ -0,0 +1,152 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <unistd.h>
+
+namespace think_parallel {
+
+// The tiers of implementation an auto front end picks from by input size.
+// What the middle and top tiers run is up to each algorithm.
+enum class algorithm_tier {
+  serial,
+  multi_pass,
+  decoupled_lookback
+};
+
+inline std::string_view to_string(algorithm_tier tier) {
+  switch (tier) {
+    case algorithm_tier::serial:     return "serial";
+    case algorithm_tier::multi_pass: return "multi_pass";
+    default:                         return "decoupled_lookback";
+  }
+}
+
+// Input sizes in bytes at which an algorithm switches tiers: it runs
+// serially below parallel_bytes, and switches to decoupled lookback at
+// lookback_bytes. The multi-pass tier is skipped if the two are equal.
+struct crossover {
+  std::size_t parallel_bytes = 256 * 1024;
+  std::size_t lookback_bytes = 4 * 1024 * 1024;
+
+  algorithm_tier tier_for(std::size_t bytes) const {
+    if (bytes < parallel_bytes)
+      return algorithm_tier::serial;
+    if (bytes < lookback_bytes)
+      return algorithm_tier::multi_pass;
+    return algorithm_tier::decoupled_lookback;
+  }
+};
+
+// Per machine parameters of the auto front ends. The defaults come from the
+// cache size and thread count; calibrate.cpp measures better ones and
+// stores them in a file of "key value" lines.
+struct tuning {
+  std::size_t tile_bytes;
+  std::size_t min_tile_bytes = 16 * 1024;
+  std::size_t num_threads;
+  crossover scan;
+  crossover copy_if;
+  crossover chunk_by;
+
+  tuning()
+    : tile_bytes(std::max<std::size_t>(cache_bytes() / 2, 64 * 1024)),
+      num_threads(std::max(std::thread::hardware_concurrency(), 1U)) {}
+
+  // The per-core cache a tile should fit in, 1 MiB if it is unknown.
+  static std::size_t cache_bytes() {
+    long bytes = -1;
+#if defined(_SC_LEVEL2_CACHE_SIZE)
+    bytes = ::sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    return bytes > 0 ? std::size_t(bytes) : 1024 * 1024;
+  }
+
+  // Unknown keys are ignored, so files from newer versions still load.
+  void read(std::istream& is) {
+    std::string key;
+    std::size_t value;
+    while (is >> key) {
+      if (key.starts_with('#') || !(is >> value)) {
+        is.clear();
+        is.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        continue;
+      }
+      fields(*this, [&] (std::string_view name, std::size_t& field) {
+        if (name == key)
+          field = value;
+      });
+    }
+    tile_bytes     = std::max<std::size_t>(tile_bytes, 1);
+    min_tile_bytes = std::max<std::size_t>(min_tile_bytes, 1);
+    num_threads    = std::max<std::size_t>(num_threads, 1);
+  }
+
+  void write(std::ostream& os) const {
+    fields(*this, [&] (std::string_view name, std::size_t field) {
+      os << name << " " << field << "\n";
+    });
+  }
+
+  static void fields(auto& t, auto f) {
+    f("tile_bytes", t.tile_bytes);
+    f("min_tile_bytes", t.min_tile_bytes);
+    f("num_threads", t.num_threads);
+    f("scan.parallel_bytes", t.scan.parallel_bytes);
+    f("scan.lookback_bytes", t.scan.lookback_bytes);
+    f("copy_if.parallel_bytes", t.copy_if.parallel_bytes);
+    f("copy_if.lookback_bytes", t.copy_if.lookback_bytes);
+    f("chunk_by.parallel_bytes", t.chunk_by.parallel_bytes);
+    f("chunk_by.lookback_bytes", t.chunk_by.lookback_bytes);
+  }
+};
+
+// The defaults, overridden by the file named by the THINK_PARALLEL_TUNING
+// environment variable if it exists.
+inline tuning load_tuning() {
+  tuning t;
+  if (auto path = std::getenv("THINK_PARALLEL_TUNING")) {
+    std::ifstream file(path);
+    if (file)
+      t.read(file);
+  }
+  return t;
+}
+
+inline tuning const& active_tuning() {
+  static tuning const t = load_tuning();
+  return t;
+}
+
+// A tile count for n elements of element_size bytes: tiles of about
+// tile_bytes, but at least four per thread for load balance while tiles stay
+// above min_tile_bytes. The count is then trimmed so that no tile is empty.
+inline std::uint32_t auto_num_tiles(std::size_t n,
+                                    std::size_t element_size,
+                                    tuning const& t = active_tuning()) {
+  if (n == 0)
+    return 1;
+
+  auto bytes = n * element_size;
+  auto by_size = (bytes + t.tile_bytes - 1) / t.tile_bytes;
+  auto by_threads = std::min(t.num_threads * 4, bytes / t.min_tile_bytes);
+  auto limit = std::min<std::size_t>(n, std::numeric_limits<std::uint32_t>::max());
+  auto num_tiles = std::uint32_t(std::clamp<std::size_t>(
+    std::max(by_size, by_threads), 1, limit));
+
+  auto tile_size = tile_size_for(n, num_tiles);
+  return std::uint32_t((n + tile_size - 1) / tile_size);
+}
+
+} // namespace think_parallel
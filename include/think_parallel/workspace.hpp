@@ -0,0 +1,71 @@
+#pragma once
+
+#include <think_parallel/tile.hpp>
+
+#include <memory>
+#include <span>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace think_parallel {
+
+inline constexpr std::size_t scratch_bytes(std::size_t bytes) {
+  return (bytes + cache_line_size - 1) / cache_line_size * cache_line_size;
+}
+
+template <typename T>
+constexpr std::size_t scratch_size_for(std::size_t n) {
+  return scratch_bytes(n * sizeof(T));
+}
+
+// A caller-owned bump arena. Algorithms taking a workspace rewind it and
+// carve their scratch out of it, growing the storage only if it is too
+// small, so reusing one workspace across calls makes them allocation free.
+struct workspace {
+  std::unique_ptr<std::byte[]> storage;
+  std::byte* base = nullptr;
+  std::size_t capacity = 0;
+  std::size_t used = 0;
+
+  workspace() = default;
+
+  explicit workspace(std::size_t bytes) { reset(bytes); }
+
+  void reset(std::size_t bytes) {
+    used = 0;
+    if (bytes <= capacity)
+      return;
+    storage  = std::make_unique_for_overwrite<std::byte[]>(bytes + cache_line_size);
+    auto raw = reinterpret_cast<std::uintptr_t>(storage.get());
+    base     = storage.get() + (scratch_bytes(raw) - raw);
+    capacity = bytes;
+  }
+
+  template <typename T>
+  std::span<T> allocate(std::size_t n) {
+    static_assert(std::is_trivially_destructible_v<T>);
+    static_assert(alignof(T) <= cache_line_size);
+
+    auto bytes = scratch_size_for<T>(n);
+    if (used + bytes > capacity)
+      throw std::bad_alloc();
+
+    auto first = reinterpret_cast<T*>(base + used);
+    used += bytes;
+    std::uninitialized_default_construct_n(first, n);
+    return {first, n};
+  }
+};
+
+// Per-thread arena for tile-local scratch. It grows to the largest tile
+// the thread has processed and is then reused by every later tile, so the
+// scratch stays cache resident. Tile bodies must not re-enter an algorithm
+// on the same thread while holding spans from it.
+inline workspace& tile_workspace() {
+  thread_local workspace ws;
+  return ws;
+}
+
+} // namespace think_parallel
@@ -1,187 +1,103 @@
+#include <think_parallel/inclusive_scan.hpp>
+#include <think_parallel/scan.hpp>
+#include <think_parallel/mapped_file.hpp>
+#include <think_parallel/streaming.hpp>
+#include <think_parallel/numa.hpp>
+#include <think_parallel/benchmark.hpp>
+
 #include <vector>
+#include <memory>
+#include <span>
 #include <ranges>
 #include <algorithm>
 #include <numeric>
 #include <execution>
-#include <atomic>
 #include <random>
-#include <chrono>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <concepts>
+#include <type_traits>
+#include <bit>
 
 namespace stdr = std::ranges;
 namespace stdv = std::views;
 namespace stde = std::execution;
+namespace tp   = think_parallel;
 
 using stdr::begin;
 using stdr::end;
 using stdr::size;
 
-auto range_for_tile(stdr::range auto&& in,
-                    std::uint32_t tile,
-                    std::uint32_t num_tiles) {
-  auto tile_size = (size(in) + num_tiles - 1) / num_tiles;
-  auto start     = std::min(tile * tile_size, size(in));
-  auto end       = std::min((tile + 1) * tile_size, size(in));
-  return stdr::subrange(next(begin(in), start), next(begin(in), end));
+template <typename T>
+constexpr std::string_view type_name() {
+  if constexpr (std::same_as<T, std::int32_t>) return "int32";
+  if constexpr (std::same_as<T, std::int64_t>) return "int64";
+  if constexpr (std::same_as<T, float>)        return "float";
+  if constexpr (std::same_as<T, double>)       return "double";
 }
 
+// Floating point inputs are small whole numbers, so the partial sums are
+// exact while they stay below 2^24 for float, and the parallel results can
+// be compared for equality whatever order they are summed in.
 template <typename T>
-struct scan_tile_state {
-  enum status {
-    status_unavailable,
-    status_local,
-    status_complete
-  };
-
-  struct descriptor {
-    T local = {};
-    T complete = {};
-    std::atomic<status> state = status_unavailable;
-  };
-
-  std::vector<descriptor> prefixes;
-
-  scan_tile_state(std::uint32_t num_tiles) : prefixes(num_tiles) {}
-
-  void set_local_prefix(std::uint32_t i, T local) {
-    if (i == 0) {
-      prefixes[i].local = local;
-      prefixes[i].complete = local;
-      prefixes[i].state.store(status_complete,
-                              std::memory_order_release);
-    } else {
-      prefixes[i].local = local;
-      prefixes[i].state.store(status_local,
-                              std::memory_order_release);
-    }
-    prefixes[i].state.notify_all();
+void run_benchmarks(tp::benchmark_harness& harness,
+                    std::uint64_t num_elements,
+                    std::uint32_t num_tiles,
+                    bool validate,
+                    tp::mapped_file const& input_file,
+                    char const* output_path,
+                    tp::workspace& ws) {
+  if (num_tiles == 0)
+    num_tiles = tp::auto_num_tiles(num_elements, sizeof(T));
+
+  // Heap storage is left untouched on allocation, and then first touched
+  // tile by tile, mostly on the NUMA node that will process each tile.
+  std::unique_ptr<T[]> in_storage, out_storage;
+  std::span<T const> in;
+  std::span<T> out;
+
+  if (input_file.data) {
+    in = input_file.as<T const>();
+  } else {
+    in_storage = std::make_unique_for_overwrite<T[]>(num_elements);
+    std::span<T> all_in(in_storage.get(), num_elements);
+    tp::for_each_tile(tp::numa_executor(), num_tiles,
+      [&] (std::uint32_t tile) {
+        auto sub_in = tp::range_for_tile(all_in, tile, num_tiles);
+
+        std::minstd_rand gen(tile);
+        std::uniform_int_distribution<std::int32_t> dis(-100, 100);
+
+        stdr::generate(sub_in, [&] { return T(dis(gen)); });
+      });
+    in = all_in;
   }
 
-  T wait_for_predecessor_prefix(std::uint32_t i) {
-    T predecessor_prefix = {};
-    for (auto p = i - 1; p >= 0; --p) {
-      auto state = prefixes[p].state.load(std::memory_order_acquire);
-      while (state == status_unavailable) {
-        prefixes[p].state.wait(status_unavailable,
-                               std::memory_order_acquire);
-        state = prefixes[p].state.load(std::memory_order_acquire);
-      }
-      if (state == status_local) {
-        predecessor_prefix = prefixes[p].local
-                           + predecessor_prefix;
-      } else if (state == status_complete) {
-        predecessor_prefix = prefixes[p].complete
-                           + predecessor_prefix;
-        break;
-      }
-    }
-
-    prefixes[i].complete = predecessor_prefix
-                           + prefixes[i].local;
-    prefixes[i].state.store(status_complete,
-                            std::memory_order_release);
-    prefixes[i].state.notify_all();
-
-    return predecessor_prefix;
+  tp::mapped_file output_file;
+  if (output_path) {
+    output_file = tp::mapped_file(std::string(output_path),
+                                  num_elements * sizeof(T));
+    out = output_file.as<T>();
+  } else {
+    out_storage = std::make_unique_for_overwrite<T[]>(num_elements);
+    out = std::span(out_storage.get(), num_elements);
+    tp::first_touch(tp::numa_executor(), out, num_tiles);
   }
-};
-
-auto inclusive_scan_upsweep_downsweep = [] (stdr::range auto&& in,
-                                            stdr::range auto&& out,
-                                            std::uint32_t num_tiles) {
-  std::vector<stdr::range_value_t<decltype(in)>> predecessors(num_tiles);
-
-  auto all_tiles = stdv::iota(0U, num_tiles);
-  std::for_each(stde::par_unseq, begin(all_tiles), end(all_tiles),
-    [&] (std::uint32_t tile) {
-      auto sub_in  = range_for_tile(in, tile, num_tiles);
-      auto sub_out = range_for_tile(out, tile, num_tiles);
-      predecessors[tile] = *--std::inclusive_scan(begin(sub_in), end(sub_in), begin(sub_out));
-    });
-
-  std::inclusive_scan(begin(predecessors), end(predecessors), begin(predecessors));
-
-  auto subsequent_tiles = stdv::iota(1U, num_tiles);
-  std::for_each(stde::par_unseq, begin(subsequent_tiles), end(subsequent_tiles),
-    [&] (std::uint32_t tile) {
-      auto sub_out = range_for_tile(out, tile, num_tiles);
-      stdr::for_each(sub_out, [&] (auto& e) { e = predecessors[tile - 1] + e; });
-    });
-};
-
-auto inclusive_scan_decoupled_lookback = [] (stdr::range auto&& in,
-                                             stdr::range auto&& out,
-                                             std::uint32_t num_tiles) {
-  scan_tile_state<stdr::range_value_t<decltype(in)>> sts(num_tiles);
-
-  std::atomic<std::uint32_t> tile_counter(0);
-
-  auto all_tiles = stdv::iota(0U, num_tiles);
-  std::for_each(stde::par, begin(all_tiles), end(all_tiles),
-    [&] (auto) {
-      auto tile = tile_counter.fetch_add(1, std::memory_order_relaxed);
-
-      auto sub_in  = range_for_tile(in, tile, num_tiles);
-      auto sub_out = range_for_tile(out, tile, num_tiles);
-
-      sts.set_local_prefix(tile,
-        *--std::inclusive_scan(begin(sub_in), end(sub_in), begin(sub_out)));
-
-      if (tile != 0) {
-        auto pred = sts.wait_for_predecessor_prefix(tile);
-        stdr::for_each(sub_out, [&] (auto& e) { e = pred + e; });
-      }
-    });
-};
-
-int main(int argc, char** argv) {
-  std::uint32_t num_elements = 1024 * 1024 * 1024;
-  std::uint32_t num_tiles = 1024;
-  bool validate = true;
-
-  if (argc > 1)
-    num_elements = std::stoul(argv[1]);
-  if (argc > 2)
-    num_tiles = std::stoul(argv[2]);
-  if (argc > 3)
-    validate = std::string_view("true") == std::string_view(argv[3]);
-
-  std::cout << "Number of Elements, " << num_elements << "\n";
-  std::cout << "Number of Tiles, " << num_tiles << "\n";
-  std::cout << "Validate, " << std::boolalpha << validate << "\n";
-  std::cout << "\n";
-
-  std::vector<std::int32_t> in(num_elements);
-  auto all_tiles = stdv::iota(0U, num_tiles);
-  std::for_each(stde::par, begin(all_tiles), end(all_tiles),
-    [&] (std::uint32_t tile) {
-      auto sub_in = range_for_tile(in, tile, num_tiles);
-
-      std::minstd_rand gen(tile);
-      std::uniform_int_distribution<std::int32_t> dis(-100, 100);
-
-      stdr::generate(sub_in, [&] { return dis(gen); });
-    });
-
-  std::vector<std::int32_t> out(num_elements);
 
-  std::vector<std::int32_t> gold;
+  std::vector<T> gold;
   if (validate) {
     gold.resize(num_elements);
     std::inclusive_scan(begin(in), end(in), begin(gold));
   }
 
-  std::cout << "Benchmark, Time [s]\n";
+  tp::benchmark_case c{type_name<T>(), num_elements, num_tiles,
+                       2 * num_elements * sizeof(T)};
 
-  auto benchmark = [&] (auto f, std::string_view name) {
-    auto start = std::chrono::high_resolution_clock::now();
-
-    f(in, out, num_tiles);
-
-    auto finish = std::chrono::high_resolution_clock::now();
-
-    std::chrono::duration<double> diff = finish - start;
-    std::cout << name << ", " << diff.count() << "\n";
+  auto benchmark_as = [&] (tp::benchmark_case const& bc, auto f,
+                           std::string_view name) {
+    harness.run(name, bc, [&] { f(in, out, num_tiles, ws); });
 
     if (validate) {
       if (!stdr::equal(out, gold))
@@ -189,9 +105,228 @@ int main(int argc, char** argv) {
     }
   };
 
-  #define BENCHMARK(f) benchmark(f, #f)
+  auto benchmark = [&] (auto f, std::string_view name) {
+    benchmark_as(c, f, name);
+  };
+
+  #define BENCHMARK(...)                                                          \
+    benchmark([] (auto&&... args)                                                 \
+              { return tp::__VA_ARGS__(std::forward<decltype(args)>(args)...); }, \
+              #__VA_ARGS__)
 
   BENCHMARK(inclusive_scan_upsweep_downsweep);
   BENCHMARK(inclusive_scan_decoupled_lookback);
+  BENCHMARK(inclusive_scan_decoupled_lookback<tp::descriptor_layout::padded>);
+  if constexpr (sizeof(T) <= 4)
+    BENCHMARK(inclusive_scan_decoupled_lookback<tp::descriptor_layout::packed>);
+  BENCHMARK(inclusive_scan_decoupled_lookback<tp::descriptor_layout::compact,
+                                              tp::lookback_strategy::windowed>);
+  BENCHMARK(inclusive_scan_decoupled_lookback<tp::descriptor_layout::padded,
+                                              tp::lookback_strategy::windowed>);
+  if constexpr (sizeof(T) <= 4)
+    BENCHMARK(inclusive_scan_decoupled_lookback<tp::descriptor_layout::packed,
+                                                tp::lookback_strategy::windowed>);
+  BENCHMARK(inclusive_scan_reduce_then_scan);
+  if constexpr (sizeof(T) <= 4)
+    BENCHMARK(inclusive_scan_reduce_then_scan<tp::descriptor_layout::packed,
+                                              tp::lookback_strategy::windowed>);
+
+  benchmark([] (auto&& in, auto&& out, auto num_tiles, auto& ws)
+            { tp::scan_inclusive(in, out, std::plus<>{}, num_tiles, ws); },
+            "scan_inclusive(std::plus<>)");
+  benchmark([] (auto&& in, auto&& out, auto num_tiles, auto& ws)
+            { tp::scan_inclusive(in, out, [] (auto l, auto r) { return l + r; },
+                                 num_tiles, ws); },
+            "scan_inclusive(generic plus)");
+  benchmark([] (auto&& in, auto&& out, auto num_tiles, auto&)
+            {
+              constexpr std::size_t num_blocks = 8;
+              tp::scan_stream<T> stream(num_tiles);
+              for (std::size_t b = 0; b < num_blocks; ++b)
+                stream(tp::range_for_tile(in, b, num_blocks),
+                       tp::range_for_tile(out, b, num_blocks));
+            },
+            "scan_stream(8 blocks)");
+  benchmark([] (auto&& in, auto&& out, auto num_tiles, auto&)
+            {
+              tp::scan_stream<T> stream(num_tiles);
+              std::size_t done = 0;
+              tp::for_each_block<T>(tp::span_reader<T>(in), (size(in) + 7) / 8,
+                [&] (auto block) {
+                  stream(block, out.subspan(done, size(block)));
+                  done += size(block);
+                });
+            },
+            "for_each_block + scan_stream(8 blocks)");
+  // inclusive_scan_auto ignores the given tile count and picks its own.
+  auto auto_case = c;
+  auto_case.num_tiles = tp::auto_num_tiles(num_elements, sizeof(T));
+  benchmark_as(auto_case,
+               [] (auto&& in, auto&& out, auto, auto& ws)
+               { tp::inclusive_scan_auto(in, out, ws); },
+               "inclusive_scan_auto");
+
+  #define POOL_BENCHMARK(...)                                                     \
+    benchmark([] (auto&&... args)                                                 \
+              { return tp::__VA_ARGS__(tp::pool_executor{},                       \
+                                       std::forward<decltype(args)>(args)...); }, \
+              #__VA_ARGS__ " (pool)")
+
+  POOL_BENCHMARK(inclusive_scan_decoupled_lookback);
+  POOL_BENCHMARK(inclusive_scan_reduce_then_scan);
+
+  #undef POOL_BENCHMARK
+
+  #define NUMA_BENCHMARK(...)                                                     \
+    benchmark([] (auto&&... args)                                                 \
+              { return tp::__VA_ARGS__(tp::numa_executor(),                       \
+                                       std::forward<decltype(args)>(args)...); }, \
+              #__VA_ARGS__ " (numa)")
+
+  NUMA_BENCHMARK(inclusive_scan_decoupled_lookback);
+  NUMA_BENCHMARK(inclusive_scan_reduce_then_scan);
+
+  #undef NUMA_BENCHMARK
+
+  #undef BENCHMARK
+
+  // What was stored through the output mapping has to reach the file.
+  if (validate && output_path) {
+    output_file.sync();
+    tp::mapped_file written{std::string(output_path)};
+    if (!stdr::equal(written.as<T const>(), gold))
+      throw bool{};
+  }
+
+  // fp_order::reproducible, on fractions whose partial sums do round. Every
+  // algorithm has to match a serial evaluation of that order bit for bit,
+  // whatever tile count it is given and whichever kernels are active.
+  if constexpr (std::floating_point<T>) {
+    auto repro_tiles = tp::scan_num_tiles<T, tp::fp_order::reproducible>(
+      num_elements, num_tiles);
+
+    std::vector<T> fractions(num_elements);
+    tp::for_each_tile(tp::numa_executor(), repro_tiles,
+      [&] (std::uint32_t tile) {
+        std::minstd_rand gen(tile);
+        std::uniform_real_distribution<T> dis(-1, 1);
+        stdr::generate(tp::range_for_tile(fractions, tile, repro_tiles),
+                       [&] { return dis(gen); });
+      });
+
+    std::vector<T> ordered;
+    if (validate) {
+      ordered.resize(num_elements);
+      T prefix{};
+      for (std::uint32_t tile = 0; tile < repro_tiles; ++tile) {
+        auto sub_in  = tp::range_for_tile(fractions, tile, repro_tiles);
+        auto sub_out = tp::range_for_tile(ordered, tile, repro_tiles);
+        T sum{};
+        for (std::size_t i = 0; i < size(sub_in); ++i) {
+          sum = sum + sub_in[i];
+          sub_out[i] = tile == 0 ? sum : prefix + sum;
+        }
+        prefix = tile == 0 ? sum : prefix + sum;
+      }
+    }
+
+    using bits_t = std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>;
+    auto bits = [] (T e) { return std::bit_cast<bits_t>(e); };
+
+    tp::benchmark_case r{type_name<T>(), num_elements, repro_tiles,
+                         2 * num_elements * sizeof(T)};
+
+    auto reproducible = [&] (auto f, std::string_view name) {
+      harness.run(name, r, [&] { f(fractions, out, num_tiles, ws); });
+
+      if (validate) {
+        if (!stdr::equal(out, ordered, {}, bits, bits))
+          throw bool{};
+      }
+    };
+
+    #define REPRODUCIBLE_BENCHMARK(...)                                             \
+      reproducible([] (auto&&... args)                                              \
+                   { return tp::__VA_ARGS__(std::forward<decltype(args)>(args)...); }, \
+                   #__VA_ARGS__)
+
+    REPRODUCIBLE_BENCHMARK(inclusive_scan_upsweep_downsweep<tp::fp_order::reproducible>);
+    REPRODUCIBLE_BENCHMARK(inclusive_scan_decoupled_lookback<tp::descriptor_layout::compact,
+                                                             tp::lookback_strategy::serial,
+                                                             tp::fp_order::reproducible>);
+    REPRODUCIBLE_BENCHMARK(inclusive_scan_reduce_then_scan<tp::descriptor_layout::compact,
+                                                           tp::lookback_strategy::serial,
+                                                           tp::fp_order::reproducible>);
+
+    #undef REPRODUCIBLE_BENCHMARK
+
+    reproducible([] (auto&& in, auto&& out, auto num_tiles, auto& ws)
+                 { tp::scan_inclusive<tp::descriptor_layout::compact,
+                                      tp::lookback_strategy::serial,
+                                      tp::fp_order::reproducible>(
+                     in, out, std::plus<>{}, num_tiles, ws); },
+                 "scan_inclusive<tp::fp_order::reproducible>(std::plus<>)");
+    reproducible([] (auto&& in, auto&& out, auto, auto& ws)
+                 { tp::inclusive_scan_auto<tp::fp_order::reproducible>(in, out, ws); },
+                 "inclusive_scan_auto<tp::fp_order::reproducible>");
+  }
 }
 
+// Usage: inclusive_scan [elements] [tiles] [validate] [input file]
+//                       [output file] [types]
+//
+// elements and tiles are comma separated lists, and tiles may be "auto";
+// every combination is run. types is a comma separated list of int32,
+// int64, float and double. Input and output files hold raw int32s.
+int main(int argc, char** argv) {
+  std::vector<std::uint64_t> element_counts{1024 * 1024 * 1024};
+  std::vector<std::uint64_t> tile_counts{0};
+  std::vector<std::string> types{"int32"};
+  bool validate = true;
+
+  if (argc > 1)
+    element_counts = tp::parse_list(argv[1]);
+  if (argc > 2)
+    tile_counts = tp::parse_list(argv[2]);
+  if (argc > 3)
+    validate = std::string_view("true") == std::string_view(argv[3]);
+  if (argc > 6)
+    types = tp::parse_names(argv[6]);
+
+  // Optionally read the input from, and write the output to, raw int32 files
+  // mapped into memory instead of generated heap vectors.
+  tp::mapped_file input_file;
+  if (argc > 4 && *argv[4]) {
+    input_file = tp::mapped_file(std::string(argv[4]));
+    element_counts = {size(input_file.as<std::int32_t const>())};
+    types = {"int32"};
+  }
+  char const* output_path = argc > 5 && *argv[5] ? argv[5] : nullptr;
+
+  tp::benchmark_harness harness;
+  harness.describe("Validate", validate);
+  harness.describe("Backend", tp::backend_name);
+  harness.describe("SIMD ISA", tp::to_string(tp::active_simd_isa()));
+  harness.describe("NUMA Nodes", size(tp::numa_nodes()));
+
+  tp::workspace ws;
+
+  for (auto const& type : types)
+  for (std::uint64_t num_elements : element_counts)
+  for (std::uint32_t num_tiles : tile_counts) {
+    if (type == "int32")
+      run_benchmarks<std::int32_t>(harness, num_elements, num_tiles, validate,
+                                   input_file, output_path, ws);
+    else if (type == "int64")
+      run_benchmarks<std::int64_t>(harness, num_elements, num_tiles, validate,
+                                   input_file, output_path, ws);
+    else if (type == "float")
+      run_benchmarks<float>(harness, num_elements, num_tiles, validate,
+                            input_file, output_path, ws);
+    else if (type == "double")
+      run_benchmarks<double>(harness, num_elements, num_tiles, validate,
+                             input_file, output_path, ws);
+    else
+      throw std::invalid_argument(type);
+  }
+}
@@ -0,0 +1,180 @@
+#include <think_parallel/radix_sort.hpp>
+#include <think_parallel/tuning.hpp>
+#include <think_parallel/benchmark.hpp>
+
+#include <vector>
+#include <ranges>
+#include <algorithm>
+#include <numeric>
+#include <execution>
+#include <random>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <concepts>
+#include <utility>
+
+namespace stdr = std::ranges;
+namespace stdv = std::views;
+namespace stde = std::execution;
+namespace tp   = think_parallel;
+
+using stdr::begin;
+using stdr::end;
+using stdr::size;
+
+template <typename T>
+constexpr std::string_view type_name() {
+  if constexpr (std::same_as<T, std::int32_t>)  return "int32";
+  if constexpr (std::same_as<T, std::uint32_t>) return "uint32";
+  if constexpr (std::same_as<T, std::int64_t>)  return "int64";
+  if constexpr (std::same_as<T, std::uint64_t>) return "uint64";
+}
+
+// Keys are uniformly distributed over the whole range of Key, so no digit
+// pass is skipped; values are the keys' original positions. Every benchmark
+// first copies the input into the buffers it sorts, and that copy is timed
+// along with the sort.
+template <typename Key>
+void run_benchmarks(tp::benchmark_harness& harness,
+                    std::uint64_t num_elements,
+                    std::uint32_t num_tiles,
+                    bool validate,
+                    tp::workspace& ws) {
+  using Value = std::uint32_t;
+
+  if (num_tiles == 0)
+    num_tiles = tp::auto_num_tiles(num_elements, sizeof(Key));
+
+  std::vector<Key> keys(num_elements);
+  auto all_tiles = stdv::iota(0U, num_tiles);
+  std::for_each(stde::par, begin(all_tiles), end(all_tiles),
+    [&] (std::uint32_t tile) {
+      std::mt19937_64 gen(tile);
+      std::uniform_int_distribution<Key> dis;
+      stdr::generate(tp::range_for_tile(keys, tile, num_tiles),
+                     [&] { return dis(gen); });
+    });
+
+  std::vector<Value> values(num_elements);
+  std::iota(begin(values), end(values), Value(0));
+
+  std::vector<Key> keys_out(num_elements);
+  std::vector<Value> values_out(num_elements);
+
+  std::vector<std::pair<Key, Value>> gold;
+  if (validate) {
+    for (std::uint64_t i = 0; i < num_elements; ++i)
+      gold.emplace_back(keys[i], values[i]);
+    stdr::stable_sort(gold, stdr::less{}, &std::pair<Key, Value>::first);
+  }
+
+  auto check = [&] (bool with_values) {
+    if (!validate)
+      return;
+    for (std::uint64_t i = 0; i < num_elements; ++i)
+      if (keys_out[i] != gold[i].first
+       || (with_values && values_out[i] != gold[i].second))
+        throw bool{};
+  };
+
+  // Reads and writes every key, and every value for the pairs.
+  tp::benchmark_case keys_only{type_name<Key>(), num_elements, num_tiles,
+                               2 * num_elements * sizeof(Key)};
+  tp::benchmark_case pairs{type_name<Key>(), num_elements, num_tiles,
+                           2 * num_elements * (sizeof(Key) + sizeof(Value))};
+
+  harness.run("std::sort (par)", keys_only,
+    [&] {
+      std::copy(stde::par, begin(keys), end(keys), begin(keys_out));
+      std::sort(stde::par, begin(keys_out), end(keys_out));
+    });
+  check(false);
+
+  harness.run("radix_sort<std::uint32_t>", keys_only,
+    [&] {
+      std::copy(stde::par, begin(keys), end(keys), begin(keys_out));
+      tp::radix_sort(keys_out, num_tiles, ws);
+    });
+  check(false);
+
+  harness.run("radix_sort<std::uint32_t> (pool)", keys_only,
+    [&] {
+      std::copy(stde::par, begin(keys), end(keys), begin(keys_out));
+      tp::radix_sort(tp::pool_executor{}, keys_out, num_tiles, ws);
+    });
+  check(false);
+
+  // The standard library has no sort by key; sorting the pairs by their key
+  // is the nearest equivalent.
+  std::vector<std::pair<Key, Value>> pairs_out(num_elements);
+  harness.run("std::stable_sort pairs (par)", pairs,
+    [&] {
+      for (std::uint64_t i = 0; i < num_elements; ++i)
+        pairs_out[i] = {keys[i], values[i]};
+      std::stable_sort(stde::par, begin(pairs_out), end(pairs_out),
+        [] (auto const& l, auto const& r) { return l.first < r.first; });
+    });
+  if (validate && pairs_out != gold)
+    throw bool{};
+
+  harness.run("radix_sort_by_key<std::uint32_t>", pairs,
+    [&] {
+      std::copy(stde::par, begin(keys), end(keys), begin(keys_out));
+      std::copy(stde::par, begin(values), end(values), begin(values_out));
+      tp::radix_sort_by_key(keys_out, values_out, num_tiles, ws);
+    });
+  check(true);
+
+  harness.run("radix_sort_by_key<std::uint32_t> (pool)", pairs,
+    [&] {
+      std::copy(stde::par, begin(keys), end(keys), begin(keys_out));
+      std::copy(stde::par, begin(values), end(values), begin(values_out));
+      tp::radix_sort_by_key(tp::pool_executor{}, keys_out, values_out,
+                            num_tiles, ws);
+    });
+  check(true);
+}
+
+// Usage: radix_sort [elements] [tiles] [validate] [types]
+//
+// elements and tiles are comma separated lists, and tiles may be "auto";
+// every combination is run. types is a comma separated list of int32,
+// uint32, int64 and uint64.
+int main(int argc, char** argv) {
+  std::vector<std::uint64_t> element_counts{256 * 1024 * 1024};
+  std::vector<std::uint64_t> tile_counts{0};
+  std::vector<std::string> types{"uint32", "uint64"};
+  bool validate = true;
+
+  if (argc > 1)
+    element_counts = tp::parse_list(argv[1]);
+  if (argc > 2)
+    tile_counts = tp::parse_list(argv[2]);
+  if (argc > 3)
+    validate = std::string_view("true") == std::string_view(argv[3]);
+  if (argc > 4)
+    types = tp::parse_names(argv[4]);
+
+  tp::benchmark_harness harness;
+  harness.describe("Validate", validate);
+  harness.describe("Backend", tp::backend_name);
+
+  tp::workspace ws;
+
+  for (auto const& type : types)
+  for (std::uint64_t num_elements : element_counts)
+  for (std::uint32_t num_tiles : tile_counts) {
+    if (type == "int32")
+      run_benchmarks<std::int32_t>(harness, num_elements, num_tiles, validate, ws);
+    else if (type == "uint32")
+      run_benchmarks<std::uint32_t>(harness, num_elements, num_tiles, validate, ws);
+    else if (type == "int64")
+      run_benchmarks<std::int64_t>(harness, num_elements, num_tiles, validate, ws);
+    else if (type == "uint64")
+      run_benchmarks<std::uint64_t>(harness, num_elements, num_tiles, validate, ws);
+    else
+      throw std::invalid_argument(type);
+  }
+}
@@ -0,0 +1,143 @@
+#include <think_parallel/segmented_scan.hpp>
+#include <think_parallel/benchmark.hpp>
+
+#include <vector>
+#include <ranges>
+#include <algorithm>
+#include <execution>
+#include <functional>
+#include <random>
+#include <iostream>
+
+namespace stdr = std::ranges;
+namespace stdv = std::views;
+namespace stde = std::execution;
+namespace tp   = think_parallel;
+
+using stdr::begin;
+using stdr::end;
+using stdr::size;
+
+int main(int argc, char** argv) {
+  std::uint64_t num_elements = 1024 * 1024 * 1024;
+  std::uint32_t num_tiles = 1024;
+  bool validate = true;
+
+  if (argc > 1)
+    num_elements = std::stoull(argv[1]);
+  if (argc > 2)
+    num_tiles = std::stoul(argv[2]);
+  if (argc > 3)
+    validate = std::string_view("true") == std::string_view(argv[3]);
+
+  tp::benchmark_harness harness;
+  harness.describe("Validate", validate);
+  harness.describe("Backend", tp::backend_name);
+
+  // Sorted keys in runs of 32 elements on average; runs may straddle tiles.
+  std::vector<std::int32_t> keys(num_elements);
+  std::vector<std::int32_t> values(num_elements);
+  auto all_tiles = stdv::iota(0U, num_tiles);
+  std::for_each(stde::par, begin(all_tiles), end(all_tiles),
+    [&] (std::uint32_t tile) {
+      auto sub_keys   = tp::range_for_tile(keys, tile, num_tiles);
+      auto sub_values = tp::range_for_tile(values, tile, num_tiles);
+
+      std::minstd_rand gen(tile);
+      std::uniform_int_distribution<std::int32_t> starts(0, 31);
+      std::uniform_int_distribution<std::int32_t> dis(-100, 100);
+
+      auto key = std::int32_t(tile * tp::tile_size_for(num_elements, num_tiles));
+      stdr::generate(sub_keys, [&] { return key += starts(gen) == 0; });
+      stdr::generate(sub_values, [&] { return dis(gen); });
+    });
+
+  std::vector<std::int32_t> keys_out(num_elements);
+  std::vector<std::int32_t> values_out(num_elements);
+
+  std::vector<std::int32_t> gold_keys, gold_values;
+  if (validate) {
+    for (std::uint64_t i = 0; i < num_elements; ++i) {
+      if (i == 0 || keys[i] != keys[i - 1]) {
+        gold_keys.push_back(keys[i]);
+        gold_values.push_back(values[i]);
+      } else {
+        gold_values.back() += values[i];
+      }
+    }
+  }
+
+  tp::workspace ws;
+
+  // Reads every key and value and writes one key and value per run.
+  std::uint64_t num_runs = 0;
+  for (std::uint64_t i = 0; i < num_elements; ++i)
+    num_runs += i == 0 || keys[i] != keys[i - 1];
+  tp::benchmark_case c{"int32", num_elements, num_tiles,
+                       (num_elements + num_runs) * 2 * sizeof(std::int32_t)};
+
+  auto benchmark = [&] (auto f, std::string_view name) {
+    auto [res_keys, res_values] = harness.run(name, c,
+      [&] {
+        return f(keys, values, keys_out, values_out,
+                 std::equal_to<>{}, std::plus<>{}, num_tiles, ws);
+      });
+
+    if (validate) {
+      if (size(res_keys) != size(gold_keys))
+        throw int{};
+
+      if (!stdr::equal(res_keys, gold_keys)
+       || !stdr::equal(res_values, gold_values))
+        throw bool{};
+    }
+  };
+
+  #define BENCHMARK(...)                                                          \
+    benchmark([] (auto&&... args)                                                 \
+              { return tp::__VA_ARGS__(std::forward<decltype(args)>(args)...); }, \
+              #__VA_ARGS__)
+
+  BENCHMARK(reduce_by_key<std::uint32_t>);
+  BENCHMARK(reduce_by_key<std::uint64_t>);
+
+  #undef BENCHMARK
+
+  // Segmented scans over the same runs; each reads every key and value and
+  // writes one value per element.
+  std::vector<std::int32_t> gold_inclusive, gold_exclusive;
+  if (validate) {
+    gold_inclusive.resize(num_elements);
+    gold_exclusive.resize(num_elements);
+    std::int32_t sum = 0;
+    for (std::uint64_t i = 0; i < num_elements; ++i) {
+      if (i == 0 || keys[i] != keys[i - 1])
+        sum = 0;
+      gold_exclusive[i] = sum;
+      gold_inclusive[i] = sum += values[i];
+    }
+  }
+
+  tp::benchmark_case scan_case{"int32", num_elements, num_tiles,
+                               3 * num_elements * sizeof(std::int32_t)};
+
+  auto benchmark_scan = [&] (auto f, auto const& gold, std::string_view name) {
+    harness.run(name, scan_case,
+      [&] { f(keys, values, values_out, num_tiles, ws); });
+
+    if (validate) {
+      if (!stdr::equal(values_out, gold))
+        throw bool{};
+    }
+  };
+
+  benchmark_scan([] (auto&& keys, auto&& in, auto&& out, auto num_tiles, auto& ws)
+                 { tp::inclusive_scan_by_key(keys, in, out, std::equal_to<>{},
+                                             std::plus<>{}, num_tiles, ws); },
+                 gold_inclusive, "inclusive_scan_by_key<std::uint32_t>");
+  benchmark_scan([] (auto&& keys, auto&& in, auto&& out, auto num_tiles, auto& ws)
+                 { tp::exclusive_scan_by_key(keys, in, out, std::int32_t(0),
+                                             std::equal_to<>{}, std::plus<>{},
+                                             num_tiles, ws); },
+                 gold_exclusive, "exclusive_scan_by_key<std::uint32_t>");
+}